@@ -0,0 +1,102 @@
+/**
+ * Per channel aggregation of readings
+ *
+ * Readings of a channel are combined into one reading per time window
+ * before they are buffered, spooled and uploaded.
+ *
+ * @copyright Copyright (c) 2011, The volkszaehler.org project
+ * @package vzlogger
+ * @license http://opensource.org/licenses/gpl-license.php GNU Public License
+ */
+/*
+ * This file is part of volkzaehler.org
+ *
+ * volkzaehler.org is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * volkzaehler.org is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _AGGREGATOR_H_
+#define _AGGREGATOR_H_
+
+#include <time.h>
+#include <list>
+
+#include <Reading.hpp>
+#include <Options.hpp>
+
+class Aggregator {
+
+	public:
+	typedef vz::shared_ptr<Aggregator> Ptr;
+
+	typedef enum {
+		aggregate_none = 0,
+		aggregate_mean,
+		aggregate_min,
+		aggregate_max,
+		aggregate_last
+	} type_t;
+
+	/**
+	 * Configure from the channel options "aggregation", "aggregation_period" and "delta"
+	 */
+	Aggregator(const std::list<Option> &options);
+
+	/**
+	 * Add a reading to the current window
+	 *
+	 * Windows are aligned to multiples of the period. A window is completed
+	 * by the first reading of a later window.
+	 *
+	 * @param out the aggregate of the completed window
+	 * @return true if out has been set
+	 */
+	bool push(const Reading &rd, Reading &out);
+
+	/**
+	 * Complete the current window before it has ended, e.g. on shutdown
+	 *
+	 * @param out the aggregate of the window
+	 * @return true if out has been set
+	 */
+	bool flush(Reading &out);
+
+	/**
+	 * @return false if readings are passed through unchanged
+	 */
+	const bool enabled() const { return _type != aggregate_none || _delta; }
+
+	private:
+	/**
+	 * Aggregate of the current window, delta encoded if configured
+	 *
+	 * @return false if there is nothing to emit
+	 */
+	bool _complete(Reading &out);
+
+	type_t _type;
+	time_t _period;
+	bool _delta;              /**< emit the difference to the previous aggregate (counters) */
+
+	/* current window */
+	time_t _window;           /**< start of the window */
+	size_t _count;
+	double _sum;
+	Reading _result;          /**< min, max or last reading */
+	struct timeval _last;     /**< time of the last reading */
+
+	bool _has_previous;
+	Reading _previous;        /**< last aggregate, base of the delta */
+};
+
+#endif /* _AGGREGATOR_H_ */
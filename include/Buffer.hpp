@@ -1,8 +1,19 @@
 /**
- * Circular buffer (double linked, threadsafe)
+ * Circular buffer (lock-free single producer/single consumer ring)
  *
  * Used to store recent readings and buffer in case of net inconnectivity
  *
+ * The reading thread is the only producer and pushes without locking.
+ * The mutex only guards the consumer side (iteration, clean(), undelete())
+ * against a concurrent resize of the ring and is used for notification.
+ * The capacity only changes with keep(), up to BUFFER_MAX_CAPACITY. When the
+ * ring is full new readings are dropped and counted, unsent ones are kept.
+ *
+ * The consumer tracks its progress with two cursors:
+ *  [tail, sent) readings handed out to the api but not yet acknowledged
+ *  [sent, head) readings not yet handed out
+ * Acknowledging or rewinding a whole batch is a single cursor move.
+ *
  * @author Steffen Vogel <info@steffenvogel.de>
  * @copyright Copyright (c) 2011, The volkszaehler.org project
  * @package vzlogger
@@ -30,35 +41,86 @@
 
 #include <pthread.h>
 #include <sys/time.h>
-#include <list>
+#include <vector>
 
 #include <Reading.hpp>
 
+#define BUFFER_MIN_CAPACITY 1024  /* minimal number of readings the ring can hold */
+#define BUFFER_MAX_CAPACITY 65536 /* upper bound for the readings kept for the local interface */
+
 class Buffer {
 
 	public:
 	typedef vz::shared_ptr<Buffer> Ptr;
-	typedef std::list<Reading>::iterator iterator;
-	typedef std::list<Reading>::const_iterator const_iterator;
 
-	Buffer();
+	/**
+	 * Iterates over all readings between the consumer and the producer cursor
+	 */
+	class iterator {
+		public:
+		iterator() : _buf(NULL), _pos(0) {}
+		iterator(Buffer *buf, size_t pos) : _buf(buf), _pos(pos) {}
+
+		Reading &operator*() const  { return _buf->_ring[_pos & _buf->_mask]; }
+		Reading *operator->() const { return &_buf->_ring[_pos & _buf->_mask]; }
+
+		iterator &operator++()   { ++_pos; return *this; }
+		iterator operator++(int) { iterator tmp(*this); ++_pos; return tmp; }
+
+		bool operator==(const iterator &rhs) const { return _pos == rhs._pos; }
+		bool operator!=(const iterator &rhs) const { return _pos != rhs._pos; }
+
+		private:
+		friend class Buffer;
+
+		Buffer *_buf;
+		size_t _pos;    /**< absolute position, wraps around with size_t */
+	};
+
+	Buffer(size_t capacity = BUFFER_MIN_CAPACITY);
 	virtual ~Buffer();
 
+	/**
+	 * Append a reading, it is dropped if the ring is full
+	 */
 	void push(const Reading &rd);
+
+	/**
+	 * Mark all readings before last as sent (in-flight)
+	 * Consumer only, call with the buffer locked
+	 */
+	void mark_sent(const iterator &last) { _sent = last._pos; }
+
+	/**
+	 * Acknowledge all sent readings and release their slots to the producer
+	 */
 	void clean();
+
+	/**
+	 * Rewind the sent cursor, all unacknowledged readings will be sent again
+	 */
 	void undelete();
 	void shrink(/*size_t keep = 0*/);
 	char *dump(char *dump, size_t len);
 
-	inline iterator begin() { return _sent.begin(); }
-	inline iterator end()   { return _sent.end(); }
-	inline size_t size() { return _sent.size(); }
+	inline iterator begin() { return iterator(this, _tail); }
+	inline iterator sent()  { return iterator(this, _sent); }
+	inline iterator end()   { return iterator(this, _head); }
+	inline size_t size() { return _head - _tail; }
+	inline size_t pending() { return _sent - _tail; } /**< handed out, not yet acknowledged */
+	inline size_t capacity() const { return _mask + 1; }
+	inline size_t dropped() const { return _dropped; }
 
 	inline const bool newValues() const { return _newValues; }
 	inline void clear_newValues() { _newValues = false; }
 
 	inline const size_t keep() { return _keep; }
-	inline void keep(const size_t keep) { _keep = keep; }
+	/**
+	 * Set the number of readings cached for the local interface
+	 *
+	 * Grows the ring if needed, producer only.
+	 */
+	void keep(const size_t keep);
 
 	inline void lock()   { pthread_mutex_lock(&_mutex); }
 	inline void unlock() { pthread_mutex_unlock(&_mutex); }
@@ -67,8 +129,22 @@ class Buffer {
 	private:
 	inline void have_newValues() { _newValues =  true; }
 
+	/**
+	 * Resize the ring to hold at least n readings
+	 *
+	 * Must only be called by the producer, the consumer is locked out by the mutex
+	 */
+	void _resize(size_t n);
+
 	private:
-	std::list<Reading> _sent;
+	std::vector<Reading> _ring; /**< preallocated slots, size is a power of two */
+	size_t _mask;               /**< capacity - 1, to map positions to slots */
+
+	volatile size_t _head;      /**< next position to write, only advanced by the producer */
+	volatile size_t _tail;      /**< oldest unacknowledged position, only advanced by the consumer */
+	size_t _sent;               /**< first position not yet handed out to the consumer */
+	volatile size_t _dropped;   /**< readings lost because the ring was full */
+
 	bool _newValues;
 
 	size_t _keep;	/**< number of readings to cache for local interface */
@@ -31,6 +31,9 @@
 
 #include "Reading.hpp"
 #include "Buffer.hpp"
+#include "Spool.hpp"
+#include "Aggregator.hpp"
+#include "Deadband.hpp"
 #include <threads.h>
 #include <Options.hpp>
 #include <VZException.hpp>
@@ -40,7 +43,7 @@ class Channel {
 	public:
 	typedef vz::shared_ptr<Channel> Ptr;
 
-	Channel(const std::list<Option> &pOptions, const std::string api, const std::string pUuid, ReadingIdentifier::Ptr pIdentifier);
+	Channel(const std::list<Option> &pOptions, const std::string api, const std::string pUuid, const ReadingIdentifier &pIdentifier);
 	virtual ~Channel();
 
 	void start() {
@@ -49,7 +52,7 @@ class Channel {
 	}
 	
 	void join() {
-		pthread_join(_thread, NULL);
+		if (running()) pthread_join(_thread, NULL);
 		_thread_running = false;
 	}
 
@@ -60,17 +63,33 @@ class Channel {
 	const char* name()                  { return _name.c_str(); }
 	std::list<Option> &options()        { return _options; }
 
-	ReadingIdentifier::Ptr identifier() {
-		if(_identifier.use_count() < 1) throw vz::VZException("Not identifier defined.") ; return _identifier; }
+	const ReadingIdentifier &identifier() const { return _identifier; }
 	const double tvtod() const          { return _last == NULL ? 0 : _last->tvtod(); }
 	
 	const char* uuid()                  { return _uuid.c_str(); }
 	const std::string apiProtocol()     { return _apiProtocol; }
 
 	void last(Reading *rd)              { _last = rd;}
-	void push(const Reading &rd)        { _buffer->push(rd); }
+	/**
+	 * Pass a reading through aggregation and deadband into spool and buffer
+	 */
+	void push(const Reading &rd);
+	/**
+	 * Pass the open aggregation window on, the meter must not push concurrently
+	 */
+	void flush();
 	char *dump(char *dump, size_t len)  { return _buffer->dump(dump, len); }
 	Buffer::Ptr buffer()                { return _buffer; }
+
+	void spool(Spool::Ptr spool)        { _spool = spool; }
+	/**
+	 * Spool of the channel, still returned after it failed to acknowledge the backlog
+	 */
+	Spool::Ptr spool()                  { return _spool; }
+	/**
+	 * @return true if new readings are written through to the spool
+	 */
+	const bool spooling() const         { return _spool && !_spool_failed; }
 	
 	const size_t size() { return _buffer->size(); }  
 	const size_t keep() { return _buffer->keep(); }  
@@ -90,6 +109,11 @@ class Channel {
 	}
 	
 	private:
+	/**
+	 * Pass a reading through the deadband into spool and buffer
+	 */
+	void _store(const Reading &rd);
+
 	static int instances;
 	bool _thread_running;   /**< flag if thread is started */
 	
@@ -98,8 +122,12 @@ class Channel {
 	std::list<Option> _options;
 	
 	Buffer::Ptr _buffer;		/**< circular queue to buffer readings */
+	Spool::Ptr _spool;		/**< persistent queue for readings to upload (optional) */
+	volatile bool _spool_failed;	/**< spool is not writable, new readings are uploaded from the buffer */
+	Aggregator::Ptr _aggregator;	/**< combines readings before they are buffered (optional) */
+	Deadband::Ptr _deadband;	/**< drops unchanged readings (optional) */
 	
-	ReadingIdentifier::Ptr _identifier;	/**< channel identifier (OBIS, string) */
+	ReadingIdentifier _identifier;	/**< channel identifier (OBIS, string) */
 	Reading *_last;			       /**< most recent reading */
 
 	pthread_cond_t condition;	 /**< pthread syncronization to notify logging thread and local webserver */
@@ -67,6 +67,13 @@ public:
 	const int &comet_timeout() const { return _comet_timeout; }
 	const int &buffer_length() const { return _buffer_length; }
 	const int retry_pause() const { return _retry_pause; }
+	const int retry_max() const { return _retry_max; }
+	const int breaker() const { return _breaker; }
+
+	const std::string &spool() const { return _spool; }
+	const int spool_size() const { return _spool_size; }
+	const int spool_sync() const { return _spool_sync; }
+	const int spool_sync_interval() const { return _spool_sync_interval; }
 
 	const bool channel_index() const { return _channel_index; }
 	const bool daemon()    const { return _daemon; }
@@ -99,6 +106,13 @@ private:
 	int _comet_timeout;	/* in seconds;  */
 	int _buffer_length;	/* in seconds; how long to buffer readings for local interfalce */
 	int _retry_pause;	/* in seconds; how long to pause after an unsuccessful HTTP request */
+	int _retry_max;		/* in seconds; upper limit of the growing pause after repeated failures */
+	int _breaker;		/* failures per middleware host before all its requests are paused */
+
+	std::string _spool;	/* directory for persistent spools, disabled if empty */
+	int _spool_size;	/* in KiB; max. size of each channels spool */
+	int _spool_sync;	/* Spool::sync_t; when to flush the spool to disk */
+	int _spool_sync_interval;	/* in seconds; for sync_interval */
 
 	/* boolean bitfields, padding at the end of struct */
 	int _channel_index:1;	/* give a index of all available channels via local interface */
@@ -0,0 +1,78 @@
+/**
+ * Per channel deadband filter
+ *
+ * Drops readings which differ less than a configured band from the last
+ * reading passed on, so unchanged samples are never buffered or uploaded.
+ *
+ * @copyright Copyright (c) 2011, The volkszaehler.org project
+ * @package vzlogger
+ * @license http://opensource.org/licenses/gpl-license.php GNU Public License
+ */
+/*
+ * This file is part of volkzaehler.org
+ *
+ * volkzaehler.org is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * volkzaehler.org is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _DEADBAND_H_
+#define _DEADBAND_H_
+
+#include <time.h>
+#include <list>
+
+#include <Reading.hpp>
+#include <Options.hpp>
+
+#define DEADBAND_DEFAULT_HEARTBEAT 300   /* seconds */
+
+class Deadband {
+
+	public:
+	typedef vz::shared_ptr<Deadband> Ptr;
+
+	/**
+	 * Configure from the channel options "deadband", "deadband_relative" and "heartbeat"
+	 */
+	Deadband(const std::list<Option> &options);
+
+	/**
+	 * Filter a reading
+	 *
+	 * A reading passes if it leaves the band around the last passed value or
+	 * if nothing has been passed for the heartbeat period. The last dropped
+	 * reading is passed before a change, so a plateau keeps its length in the
+	 * graph instead of becoming a ramp.
+	 *
+	 * @param out at least two readings
+	 * @return number of readings stored in out
+	 */
+	size_t push(const Reading &rd, Reading *out);
+
+	/**
+	 * @return false if no band has been configured
+	 */
+	const bool enabled() const { return _absolute >= 0 || _relative >= 0; }
+
+	private:
+	double _absolute;         /**< band in units of the value, <0 if unused */
+	double _relative;         /**< band as fraction of the last value, <0 if unused */
+	int _heartbeat;           /**< seconds, 0 to disable */
+
+	bool _has_last;
+	Reading _last;            /**< last reading passed on */
+	bool _has_held;
+	Reading _held;            /**< last reading dropped since */
+};
+
+#endif /* _DEADBAND_H_ */
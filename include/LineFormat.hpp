@@ -0,0 +1,96 @@
+/**
+ * Compiled format for parsing readings from text lines
+ *
+ * A format like "$i $v $t" is compiled once into a small token program
+ * which parses each line in place without allocating memory.
+ *
+ * @copyright Copyright (c) 2011, The volkszaehler.org project
+ * @package vzlogger
+ * @license http://opensource.org/licenses/gpl-license.php GNU Public License
+ */
+/*
+ * This file is part of volkzaehler.org
+ *
+ * volkzaehler.org is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * volkzaehler.org is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LINEFORMAT_H_
+#define _LINEFORMAT_H_
+
+#include <string>
+#include <vector>
+
+#include <Reading.hpp>
+
+#define LINEFORMAT_CACHE_SIZE 16  /* recently used identifiers */
+
+class LineFormat {
+
+	public:
+	/**
+	 * Compile a format string
+	 *
+	 * "$v" => value
+	 * "$i" => identifier (a word without whitespace)
+	 * "$t" => timestamp (seconds since epoch, fractions allowed)
+	 *
+	 * Whitespace matches any amount of whitespace, other text has to match
+	 * literally. At least $v has to be used.
+	 */
+	LineFormat(const std::string &format = "$v");
+
+	/**
+	 * Parse a line into rd
+	 *
+	 * Readings without timestamp get the current time, readings without
+	 * identifier an empty string identifier.
+	 *
+	 * @return false if the line contains no value
+	 */
+	bool parse(const char *line, Reading &rd);
+
+	const std::string &format() const { return _format; }
+
+	private:
+	typedef enum {
+		token_space,        /* skip whitespace */
+		token_literal,      /* match text */
+		token_value,
+		token_identifier,
+		token_timestamp
+	} token_type_t;
+
+	typedef struct {
+		token_type_t type;
+		std::string literal;
+	} token_t;
+
+	typedef struct {
+		std::string name;
+		StringIdentifier id;
+	} cache_t;
+
+	/**
+	 * Lookup identifier in the cache, intern it on a miss
+	 */
+	const StringIdentifier &_identifier(const char *name, size_t len);
+
+	std::string _format;
+	std::vector<token_t> _program;
+
+	std::vector<cache_t> _cache;
+	size_t _cache_next;   /* entry to be replaced next */
+};
+
+#endif /* _LINEFORMAT_H_ */
@@ -0,0 +1,91 @@
+/**
+ * Buffered line reader for files, fifos and sockets
+ *
+ * Reads large chunks and hands out complete lines in place.
+ *
+ * @copyright Copyright (c) 2011, The volkszaehler.org project
+ * @package vzlogger
+ * @license http://opensource.org/licenses/gpl-license.php GNU Public License
+ */
+/*
+ * This file is part of volkzaehler.org
+ *
+ * volkzaehler.org is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * volkzaehler.org is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LINEREADER_H_
+#define _LINEREADER_H_
+
+#include <sys/types.h>
+#include <vector>
+
+#define LINEREADER_CHUNK_SIZE 4096    /* bytes read at once */
+#define LINEREADER_MAX_LINE 65536     /* longer lines are discarded */
+
+class LineReader {
+
+	public:
+	LineReader(size_t max_line = LINEREADER_MAX_LINE);
+
+	/**
+	 * Read the next chunk from fd into the buffer
+	 *
+	 * @return number of bytes read, 0 on end of file, <0 on error (see errno)
+	 */
+	ssize_t fill(int fd);
+
+	/**
+	 * Append a chunk which has already been read by the caller
+	 */
+	void append(const char *data, size_t len);
+
+	/**
+	 * Next complete line
+	 *
+	 * The line terminator ("\n" or "\r\n") is replaced by '\0' in the buffer.
+	 * The line stays valid until the next call of fill(), append() or clear().
+	 *
+	 * @return line or NULL if there is no complete line buffered
+	 */
+	char *next(size_t *len = NULL);
+
+	/**
+	 * Take the incomplete last line, e.g. at the end of a file
+	 *
+	 * @return line or NULL if nothing is buffered
+	 */
+	char *rest(size_t *len = NULL);
+
+	/**
+	 * Drop all buffered data, e.g. after seeking
+	 */
+	void clear();
+
+	size_t pending() const { return _end - _begin; }
+
+	private:
+	/**
+	 * Make room for at least LINEREADER_CHUNK_SIZE bytes
+	 */
+	void _reserve();
+
+	std::vector<char> _buffer;
+	size_t _begin;        /**< start of the first unread line */
+	size_t _scan;         /**< no line terminator before this position */
+	size_t _end;          /**< end of buffered data */
+	size_t _max_line;
+	bool _discard;        /**< skipping the rest of an overlong line */
+};
+
+#endif /* _LINEREADER_H_ */
@@ -48,6 +48,14 @@ public:
 	int close();
 	size_t read(std::vector<Reading> &rds, size_t n);
 
+	int fd() const { return _protocol->fd(); }
+	ssize_t feed(const char *data, size_t len, std::vector<Reading> &rds, size_t n) {
+		return _protocol->feed(data, len, rds, n);
+	}
+	ssize_t eof(std::vector<Reading> &rds, size_t n) { return _protocol->eof(rds, n); }
+	time_t deadline() const { return _protocol->deadline(); }
+	void timeout() { _protocol->timeout(); }
+
 // setter
 	void interval(const int i) { _interval = i; }
 
@@ -58,7 +66,7 @@ public:
 	const meter_protocol_t protocolId() const { return _protocol_id; } 
 	vz::protocol::Protocol::Ptr protocol() { return _protocol; }
 
-	ReadingIdentifier::Ptr identifier()    { return _identifier; }
+	const ReadingIdentifier &identifier() const { return _identifier; }
 
 	const int  interval() const            { return _interval; }
 
@@ -73,7 +81,7 @@ private:
 	meter_protocol_t _protocol_id;          /**< meter protocol id */
 	vz::protocol::Protocol::Ptr _protocol;  /**< meter protocol */
 
-	ReadingIdentifier::Ptr _identifier;
+	ReadingIdentifier _identifier;
 
 
 	int _interval;
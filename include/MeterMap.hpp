@@ -38,6 +38,7 @@
 #define _MeterMap_hpp_
 #include <pthread.h>
 #include <vector>
+#include <unordered_map>
 
 #include <common.h>
 #include <Options.hpp>
@@ -52,8 +53,10 @@ public:
 	typedef vz::shared_ptr<MeterMap> Ptr;
 	typedef std::vector<Channel::Ptr>::iterator iterator;
 	typedef std::vector<Channel::Ptr>::const_iterator const_iterator;
+	typedef std::vector<Channel::Ptr> channel_list;
 
-	MeterMap(std::list<Option> options) : _meter(new Meter(options)){}
+	MeterMap(std::list<Option> options)
+			: _meter(new Meter(options)), _masks(1, 0), _reactor(false), _scheduled(false), _thread_running(false) {}
 	~MeterMap() {};
 	Meter::Ptr meter() { return _meter; }
 
@@ -63,7 +66,7 @@ public:
 	void start();
 
 /**
-	 check if meter-thread is joinable
+	 check if meter-thread has terminated and join it, does not block
 */
 	bool stopped();
 
@@ -72,6 +75,11 @@ public:
  */
 	void cancel();
 
+/**
+ * pass the open aggregation windows of all channels on, once the meter has stopped
+ */
+	void flush();
+
 /**
  * send device-registration for each channel
  */
@@ -87,10 +95,40 @@ public:
 
 	const bool running() const { return _thread_running; }
 
+/**
+ * Build the identifier index for reading dispatch
+ *
+ * Has to be called after all channels have been added.
+ */
+	void index();
+
+/**
+ * Channels subscribed to exactly this key
+ *
+ * Channels with OBIS wildcards are indexed by their key with the wildcard
+ * groups set to 0xff, they are found by masking the reading key the same way.
+ * Channels with a nil identifier are returned by subscribers_wildcard().
+ */
+	const channel_list &subscribers(uint64_t key) const;
+	const channel_list &subscribers_wildcard() const { return _wildcards; }
+
+/**
+ * Route new readings to the subscribed channels and notify them
+ *
+ * Called by the reading thread or the meter reactor.
+ */
+	void dispatch(std::vector<Reading> &rds, size_t n);
+
 private:
 	Meter::Ptr _meter;
 	std::vector<Channel::Ptr> _channels;
 
+	std::unordered_map<uint64_t, channel_list> _index; /**< channels by identifier key */
+	std::vector<uint64_t> _masks;                      /**< distinct OBIS wildcard masks of the channels, 0 first */
+	channel_list _wildcards;                           /**< channels with nil identifier, subscribed to everything */
+
+	bool _reactor;          /**< meter is driven by the MeterReactor instead of its own thread */
+	bool _scheduled;        /**< meter is polled by the MeterScheduler instead of its own thread */
 	bool _thread_running;   /**< flag if thread is started */
 	pthread_t _thread;      /**< Thread data for meter (reading) */
 };
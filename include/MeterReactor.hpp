@@ -0,0 +1,135 @@
+/**
+ * Event loop for meters with non-blocking file descriptors
+ *
+ * @copyright Copyright (c) 2011, The volkszaehler.org project
+ * @package vzlogger
+ * @license http://opensource.org/licenses/gpl-license.php GNU Public License
+ */
+/*
+ * This file is part of volkzaehler.org
+ *
+ * volkzaehler.org is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * volkzaehler.org is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _MeterReactor_hpp_
+#define _MeterReactor_hpp_
+
+#include <list>
+#include <vector>
+#include <pthread.h>
+#include <time.h>
+
+#include <Reading.hpp>
+
+#define REACTOR_CHUNK_SIZE 4096   /* bytes read from a meter at once */
+#define REACTOR_MAX_EVENTS 16
+#define REACTOR_REOPEN_DELAY 1      /* seconds before the first reopen attempt */
+#define REACTOR_REOPEN_MAX_DELAY 60 /* upper bound of the doubled delay */
+
+class MeterMap;
+
+/**
+ * Drives all event driven meters from a single thread
+ *
+ * Meters whose protocol exposes a file descriptor are registered with one
+ * epoll instance instead of blocking a thread each. Readable data is passed
+ * in chunks to the incremental parser of the protocol and completed readings
+ * are dispatched to the channels of the meter. Protocols with a deadline()
+ * are called back from the same thread, e.g. to start or stop a command.
+ */
+class MeterReactor {
+public:
+	static MeterReactor &instance();
+
+	/**
+	 * Register an opened meter, has to be called before start()
+	 */
+	void add(MeterMap *mapping);
+
+	void start();
+	void cancel();
+
+	/**
+	 * Join the reactor thread if it has terminated, does not block
+	 *
+	 * @return true if the thread has been joined (by this or a previous call)
+	 */
+	bool join();
+
+	const bool running() const { return _thread_running; }
+	const size_t size() const  { return _sources.size(); }
+
+private:
+	typedef struct {
+		MeterMap *mapping;
+		std::vector<Reading> rds;   /**< readings completed by feed() */
+		size_t max_readings;
+		int fd;                     /**< watched descriptor or -1 */
+		time_t last;                /**< time of the last dispatch, for the interval */
+		time_t reopen_at;           /**< next reopen attempt of a closed meter, 0 if open */
+		int reopen_delay;           /**< doubled with each attempt, reset by readings */
+	} source_t;
+
+	MeterReactor();
+	~MeterReactor();
+
+	void watch(source_t &source);
+	void unwatch(source_t &source);
+
+	static void * thread(void *arg);
+	void run();
+
+	/**
+	 * Read all available bytes of a meter and dispatch the readings
+	 *
+	 * @return false if the meter has been closed (EOF or error)
+	 */
+	bool handle(source_t &source);
+
+	/**
+	 * Hand a batch of completed readings over to the channels
+	 */
+	void deliver(source_t &source, size_t n);
+
+	/**
+	 * Close a meter after EOF or error and schedule its reopen
+	 *
+	 * Attempts are delayed per meter, so a meter which closes again right
+	 * away does not keep the reactor busy.
+	 */
+	void reopen(source_t &source);
+
+	/**
+	 * Reopen all meters whose delay has passed
+	 *
+	 * @return milliseconds until the next attempt, -1 if none is pending
+	 */
+	int reopen_due();
+
+	/**
+	 * Call the protocols whose deadline has passed and watch new descriptors
+	 *
+	 * @return milliseconds until the next deadline, -1 if none is pending
+	 */
+	int timers_due();
+
+	int _epfd;
+	std::list<source_t> _sources;   /**< stable addresses, used as epoll data */
+
+	bool _thread_running;
+	bool _thread_joined;
+	pthread_t _thread;
+}; // class MeterReactor
+
+#endif /* _MeterReactor_hpp_ */
@@ -0,0 +1,141 @@
+/**
+ * Timer wheel for periodic meters
+ *
+ * @copyright Copyright (c) 2011, The volkszaehler.org project
+ * @package vzlogger
+ * @license http://opensource.org/licenses/gpl-license.php GNU Public License
+ */
+/*
+ * This file is part of volkzaehler.org
+ *
+ * volkzaehler.org is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * volkzaehler.org is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _MeterScheduler_hpp_
+#define _MeterScheduler_hpp_
+
+#include <list>
+#include <vector>
+#include <pthread.h>
+#include <time.h>
+
+#include <Reading.hpp>
+
+#define SCHEDULER_WHEEL_BITS 6                              /* slots per level as power of 2 */
+#define SCHEDULER_WHEEL_SIZE (1 << SCHEDULER_WHEEL_BITS)
+#define SCHEDULER_WHEEL_MASK (SCHEDULER_WHEEL_SIZE - 1)
+#define SCHEDULER_LEVELS 4                                  /* covers 64^4 s (194 days) */
+#define SCHEDULER_MAX_CATCHUP 3600                          /* larger clock jumps rebuild the wheel */
+#define SCHEDULER_DEFAULT_INTERVAL 10                       /* for meters without interval */
+
+class MeterMap;
+
+/**
+ * Polls all periodic meters from a single thread
+ *
+ * Meters whose protocol is scheduled() are read at each wall clock
+ * multiple of their interval (e.g. at :00, :15, :30, :45 for 15 s). The
+ * polls are kept in a hierarchical timer wheel with one second ticks:
+ * level 0 holds the next 64 seconds, each further level 64 times more and
+ * is cascaded down as time advances. The thread only wakes up for due
+ * polls and cascades.
+ *
+ * If a poll is late (slow meter or suspended system), the ticks passed in
+ * between are counted as missed and the meter continues at the next
+ * boundary.
+ */
+class MeterScheduler {
+public:
+	static MeterScheduler &instance();
+
+	/**
+	 * Register an opened meter, has to be called before start()
+	 */
+	void add(MeterMap *mapping);
+
+	void start();
+	void cancel();
+
+	/**
+	 * Join the scheduler thread if it has terminated, does not block
+	 *
+	 * @return true if the thread has been joined (by this or a previous call)
+	 */
+	bool join();
+
+	const bool running() const { return _thread_running; }
+	const size_t size() const  { return _sources.size(); }
+
+private:
+	typedef struct {
+		MeterMap *mapping;
+		std::vector<Reading> rds;
+		size_t max_readings;
+		int interval;               /**< seconds between polls */
+		time_t next;                /**< next poll, multiple of interval */
+		unsigned long missed;       /**< polls skipped because the meter was late */
+	} source_t;
+
+	typedef std::list<source_t *> slot_t;
+
+	MeterScheduler();
+	~MeterScheduler();
+
+	static void * thread(void *arg);
+	void run();
+
+	/**
+	 * Put a source into the slot of its next poll
+	 */
+	void insert(source_t &source);
+
+	/**
+	 * Process the tick _next: cascade upper levels and poll the due meters
+	 */
+	void tick();
+
+	/**
+	 * Move the entries of a slot of an upper level down
+	 *
+	 * @return index of the slot, 0 if the next level has to be cascaded too
+	 */
+	int cascade(int level);
+
+	/**
+	 * Redistribute all sources after the wall clock jumped
+	 */
+	void rebuild(time_t now);
+
+	/**
+	 * @return next tick which polls a meter or cascades an upper level
+	 */
+	time_t wakeup() const;
+
+	void poll(source_t &source);
+
+	/**
+	 * Schedule the poll following now, count the skipped ones
+	 */
+	void reschedule(source_t &source, time_t now);
+
+	std::list<source_t> _sources;   /**< stable addresses, referenced by the wheel */
+	slot_t _wheel[SCHEDULER_LEVELS][SCHEDULER_WHEEL_SIZE];
+	time_t _next;                   /**< next tick to process */
+
+	bool _thread_running;
+	bool _thread_joined;
+	pthread_t _thread;
+}; // class MeterScheduler
+
+#endif /* _MeterScheduler_hpp_ */
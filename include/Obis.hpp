@@ -48,6 +48,8 @@ class Obis {
 	const bool isManufacturerSpecific() const;
 	const bool isNull() const;
 
+	const unsigned char *raw() const { return _obisId._raw; }
+
 	private:
 	int parse(const char *str);
 	int lookup_alias(const char *alias);
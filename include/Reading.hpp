@@ -31,108 +31,137 @@
 
 #include <sys/time.h>
 #include <string.h>
+#include <stdint.h>
+#include <math.h>
 
 #include "Obis.hpp"
 #include <shared_ptr.hpp>
 #include <meter_protocol.hpp>
 
 #define MAX_IDENTIFIER_LEN 255
+#define READING_POW10_MAX 22   /* largest power of ten exactly representable as double */
 
 /* Identifiers */
+
+/**
+ * Compact identifier value type
+ *
+ * All identifiers are encoded into a tagged 64 bit key, the tag is stored in the
+ * most significant byte:
+ *  obis:    6 raw OBIS bytes, groups set to 0xff are a wildcard in channel identifiers
+ *  channel: the signed fluksometer channel number
+ *  string:  id of the interned string
+ *  nil:     zero, matches any other identifier
+ *
+ * Identifiers are created without heap allocation (except for the first
+ * occurence of an interned string) and are compared by their key.
+ */
 class ReadingIdentifier {
 public:
-	typedef vz::shared_ptr<ReadingIdentifier> Ptr;
-	virtual ~ReadingIdentifier(){};
-
-	virtual size_t unparse(char *buffer, size_t n) = 0;
-	bool operator==( ReadingIdentifier &cmp);
-	bool compare( ReadingIdentifier *lhs,  ReadingIdentifier *rhs);
-
-	virtual const std::string toString()  = 0;
+	typedef enum {
+		type_nil = 0,
+		type_obis,
+		type_channel,
+		type_string
+	} type_t;
+
+	ReadingIdentifier() : _key(0) {}
+
+	size_t unparse(char *buffer, size_t n) const;
+	const std::string toString() const;
+
+	inline bool operator==(const ReadingIdentifier &cmp) const {
+		return (_key == cmp._key) || compare(cmp);
+	}
+	inline bool operator!=(const ReadingIdentifier &cmp) const { return !(*this == cmp); }
+
+	const type_t type() const   { return (type_t) (_key >> 56); }
+	const uint64_t key() const  { return _key; }
+
+	/**
+	 * Bytes of the OBIS groups set to 0xff, 0 for other types
+	 *
+	 * Only channel identifiers treat these groups as wildcards, in readings
+	 * they are concrete values (e.g. F=0xff sent by SML meters).
+	 */
+	const uint64_t mask() const {
+		uint64_t mask = 0;
+		if (type() == type_obis) {
+			for (int i = 0; i < 6; i++) {
+				if (((_key >> (8 * i)) & 0xff) == 0xff) mask |= 0xffULL << (8 * i);
+			}
+		}
+		return mask;
+	}
+
+	/**
+	 * Check if this channel identifier may match identifiers with another key
+	 */
+	const bool wildcard() const { return type() == type_nil || mask() != 0; }
 
 protected:
-	explicit ReadingIdentifier() {};
+	explicit ReadingIdentifier(type_t type, uint64_t value)
+			: _key(((uint64_t) type << 56) | value) {}
+
+	const uint64_t value() const { return _key & 0x00ffffffffffffffULL; }
 
 private:
-//ReadingIdentifier (const ReadingIdentifier& original);
-//ReadingIdentifier& operator= (const ReadingIdentifier& rhs);
+	/**
+	 * Slow path if keys are not equal: nil and OBIS wildcards
+	 */
+	bool compare(const ReadingIdentifier &cmp) const;
+
+	uint64_t _key;
 };
 
 class ObisIdentifier : public ReadingIdentifier {
 
 public:
-	typedef vz::shared_ptr<ObisIdentifier> Ptr;
-
-	ObisIdentifier() {}
-	ObisIdentifier(Obis obis) : _obis(obis) {}
-	virtual ~ObisIdentifier(){};
-
-	size_t unparse(char *buffer, size_t n);
-	bool operator==(ObisIdentifier &cmp);
-	const std::string toString() {
-		std::ostringstream oss;
-		oss << "ObisItentifier:" << _obis.toString();
-		return oss.str();
-	};
+	ObisIdentifier() : ReadingIdentifier(type_obis, 0) {}
+	ObisIdentifier(const Obis &obis) : ReadingIdentifier(type_obis, encode(obis.raw())) {}
+	/** from the 6 raw bytes of an OBIS code, e.g. as sent by the meter */
+	explicit ObisIdentifier(const unsigned char *raw) : ReadingIdentifier(type_obis, encode(raw)) {}
 
-	const Obis &obis() const { return _obis; }
+	const Obis obis() const { return decode(value()); }
 
-private:
-	//ObisIdentifier (const ObisIdentifier& original);
-	//ObisIdentifier& operator= (const ObisIdentifier& rhs);
-
-protected:
-	Obis _obis;
+	static uint64_t encode(const Obis &obis) { return encode(obis.raw()); }
+	static uint64_t encode(const unsigned char *raw);
+	static Obis decode(uint64_t value);
 };
 
 class StringIdentifier : public ReadingIdentifier {
 public:
-	StringIdentifier() {}
-	StringIdentifier(std::string s) : _string(s) {}
-
-	void parse(const char *buffer);
-	size_t unparse(char *buffer, size_t n);
-	bool operator==(StringIdentifier &cmp);
-	const std::string toString()  {
-		std::ostringstream oss;
-		oss << "StringItentifier:";
-		return oss.str();
-	};
-protected:
-	std::string _string;
+	StringIdentifier() : ReadingIdentifier(type_string, intern("")) {}
+	StringIdentifier(const std::string &s) : ReadingIdentifier(type_string, intern(s)) {}
+	StringIdentifier(const char *s) : ReadingIdentifier(type_string, intern(s)) {}
+
+	/**
+	 * Lookup or insert string in the global string table
+	 *
+	 * @return the id of the interned string
+	 */
+	static uint32_t intern(const std::string &s);
+	static const std::string lookup(uint32_t id);
 };
 
 
 class ChannelIdentifier : public ReadingIdentifier {
 
 public:
-	ChannelIdentifier() {}
-	ChannelIdentifier(int channel) : _channel(channel) {}
-
-	void parse(const char *string);
-	size_t unparse(char *buffer, size_t n);
-	bool operator==(ChannelIdentifier &cmp);
-	const std::string toString()  {
-		std::ostringstream oss;
-		oss << "ChannelItentifier:";
-		return oss.str();
-	};
+	ChannelIdentifier() : ReadingIdentifier(type_channel, 0) {}
+	ChannelIdentifier(int channel) : ReadingIdentifier(type_channel, (uint32_t) channel) {}
 
-protected:
-	int _channel;
+	/**
+	 * Parse "sensor<n>/<power|consumption>"
+	 */
+	static ChannelIdentifier parse(const char *string);
+
+	const int channel() const { return (int32_t) (uint32_t) value(); }
 };
 
 class NilIdentifier : public ReadingIdentifier {
 public:
 	NilIdentifier() {}
-	size_t unparse(char *buffer, size_t n);
-	bool operator==(NilIdentifier &cmp);
-	const std::string toString()  {
-		std::ostringstream oss;
-		oss << "NilItentifier";
-		return oss.str();
-	};
-private:
 };
 
 class Reading {
@@ -140,25 +169,58 @@ class Reading {
 public:
 	typedef vz::shared_ptr<Reading> Ptr;
 	Reading();
-	Reading(ReadingIdentifier::Ptr pIndentifier);
-	Reading(double pValue, struct timeval pTime, ReadingIdentifier::Ptr pIndentifier);
+	Reading(const ReadingIdentifier &pIndentifier);
+	Reading(double pValue, struct timeval pTime, const ReadingIdentifier &pIndentifier);
 	Reading(const Reading &orig);
+	Reading &operator=(const Reading &orig);
 
-	const bool deleted() const { return _deleted; }
-	void  mark_delete()        { _deleted = true; }
-	void  reset()              { _deleted = false; }
-
-	void value(const double &v) { _value = v; }
+	void value(const double &v) { _value = v; _exact = false; }
 	const double value() const  { return _value; }
 
+	/**
+	 * Set the exact value mantissa * 10^exponent, e.g. of a meter register
+	 *
+	 * The double value is derived from it. Consumers may use the exact
+	 * representation to avoid floating point drift.
+	 */
+	void value(int64_t mantissa, int exponent) {
+		_mantissa = mantissa;
+		_exponent = exponent;
+		_exact = true;
+		_value = (exponent >= 0) ? mantissa * pow10(exponent) : mantissa / pow10(-exponent);
+	}
+	const bool exact() const        { return _exact; }
+	const int64_t mantissa() const  { return _mantissa; }
+	const int exponent() const      { return _exponent; }
+
+	/**
+	 * Unit as DLMS/COSEM unit code, e.g. 27 = W, 30 = Wh; 0 if unknown
+	 */
+	void unit(int unit)             { _unit = unit; }
+	const int unit() const          { return _unit; }
+
+	/**
+	 * 10^exponent, from a table for the usual range of meter scalers
+	 */
+	static double pow10(int exponent) {
+		return (exponent >= 0 && exponent <= READING_POW10_MAX) ? _pow10[exponent] : ::pow(10, exponent);
+	}
+
 	const  double tvtod() const;
+	/**
+	 * Timestamp in milliseconds, rounded to nearest
+	 *
+	 * Used for the api timestamps and their duplicate detection alike.
+	 */
+	const int64_t tvtoms() const { return (int64_t) _time.tv_sec * 1000 + (_time.tv_usec + 500) / 1000; }
 	double tvtod(struct timeval tv);
 	void time() { gettimeofday(&_time, NULL); }
 	void time(struct timeval &v) { _time = v; }
+	const struct timeval &tv() const { return _time; }
 	struct timeval dtotv(double ts);
 
-	void identifier(ReadingIdentifier *rid)  { _identifier.reset(rid); }
-	const ReadingIdentifier::Ptr identifier() { return _identifier; }
+	void identifier(const ReadingIdentifier &rid) { _identifier = rid; }
+	const ReadingIdentifier &identifier() const   { return _identifier; }
 
 /**
  * Print identifier to buffer for debugging/dump
@@ -168,10 +230,15 @@ public:
     size_t unparse(/*meter_protocol_t protocol,*/ char *buffer, size_t n);
 
 protected:
-	bool   _deleted;
+	static const double _pow10[READING_POW10_MAX + 1];
+
 	double _value;
+	int64_t _mantissa;
+	int _exponent;
+	bool _exact;         /**< _mantissa and _exponent are valid */
+	unsigned char _unit; /**< DLMS unit code reported by the meter */
 	struct timeval _time;
-	ReadingIdentifier::Ptr _identifier;
+	ReadingIdentifier _identifier;
 };
 
 /**
@@ -181,7 +248,7 @@ protected:
  * @param string the string-encoded identifier
  * @return 0 on success, < 0 on error
  */
-ReadingIdentifier::Ptr reading_id_parse(meter_protocol_t protocol, const char *string);
+ReadingIdentifier reading_id_parse(meter_protocol_t protocol, const char *string);
 
 
 #endif /* _READING_H_ */
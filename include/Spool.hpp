@@ -0,0 +1,125 @@
+/**
+ * Persistent spool for readings (append-only segment log)
+ *
+ * Keeps readings of a channel on disk until they are acknowledged by the
+ * middleware, so they survive outages and restarts.
+ *
+ * @copyright Copyright (c) 2011, The volkszaehler.org project
+ * @package vzlogger
+ * @license http://opensource.org/licenses/gpl-license.php GNU Public License
+ */
+/*
+ * This file is part of volkzaehler.org
+ *
+ * volkzaehler.org is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * volkzaehler.org is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SPOOL_H_
+#define _SPOOL_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+#include <deque>
+#include <list>
+#include <string>
+
+#include <Reading.hpp>
+
+#define SPOOL_SEGMENT_RECORDS 4096    /* readings per segment file */
+#define SPOOL_BATCH 1024              /* max. readings read from the spool at once */
+#define SPOOL_MAGIC 0x767a7270        /* marks a completely written record */
+
+class Spool {
+
+	public:
+	typedef vz::shared_ptr<Spool> Ptr;
+
+	typedef enum {
+		sync_never = 0,   /* leave writeback to the kernel */
+		sync_interval,    /* flush at most every n seconds */
+		sync_always       /* flush after each reading and acknowledgement */
+	} sync_t;
+
+	/**
+	 * Open or create the spool in directory path and recover its state
+	 *
+	 * @param max_size the spool drops the oldest segments if it grows above (bytes)
+	 */
+	Spool(const std::string &path, size_t max_size, sync_t sync, int interval);
+	virtual ~Spool();
+
+	/**
+	 * Append a reading (producer)
+	 */
+	void append(const Reading &rd);
+
+	/**
+	 * Read up to max readings following the last read into preallocated slots (consumer)
+	 *
+	 * @return number of readings stored in rds
+	 */
+	size_t read(Reading *rds, size_t max, const ReadingIdentifier &id);
+
+	/**
+	 * Acknowledge all readings read so far and remove finished segments (consumer)
+	 */
+	void ack();
+
+	inline size_t size() { return _write - _ack; }
+	const std::string &path() const { return _path; }
+
+	private:
+	typedef struct {
+		uint32_t magic;
+		uint32_t usec;
+		int64_t sec;
+		double value;
+	} record_t;
+
+	typedef struct {
+		uint64_t number;      /**< first record is number * SPOOL_SEGMENT_RECORDS */
+		int fd;
+		record_t *records;    /**< mapped segment file */
+	} segment_t;
+
+	void _open_segment(uint64_t number, bool create);
+	void _drop_segment();
+	void _sync(int fd, void *addr, size_t len, bool force);
+	std::string _segment_path(uint64_t number) const;
+
+	inline record_t *_record(uint64_t pos) {
+		return &_segments[pos / SPOOL_SEGMENT_RECORDS - _segments.front().number].records[pos % SPOOL_SEGMENT_RECORDS];
+	}
+
+	private:
+	std::string _path;
+	size_t _max_segments;
+	sync_t _sync_policy;
+	int _sync_interval;
+	time_t _last_sync;
+
+	std::deque<segment_t> _segments;  /**< consecutive segments, oldest first */
+
+	uint64_t _write;      /**< next record to write */
+	uint64_t _read;       /**< next record to read */
+	uint64_t _ack;        /**< first unacknowledged record */
+
+	int _state_fd;
+	uint64_t *_state;     /**< persisted acknowledgement position */
+
+	pthread_mutex_t _mutex;
+};
+
+#endif /* _SPOOL_H_ */
@@ -0,0 +1,128 @@
+/**
+ * Retry scheduling for failed requests
+ *
+ * @copyright Copyright (c) 2011, The volkszaehler.org project
+ * @package vzlogger
+ * @license http://opensource.org/licenses/gpl-license.php GNU Public License
+ */
+/*
+ * This file is part of volkzaehler.org
+ *
+ * volkzaehler.org is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * volkzaehler.org is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _Backoff_hpp_
+#define _Backoff_hpp_
+
+#include <map>
+#include <string>
+#include <pthread.h>
+#include <time.h>
+
+#include <shared_ptr.hpp>
+
+#define BACKOFF_MAX_SHIFT 16   /* limits the exponent, the cap applies anyway */
+
+namespace vz {
+	namespace api {
+
+		/**
+		 * Exponential backoff with jitter
+		 *
+		 * The n-th consecutive failure delays the next attempt by
+		 * min(cap, base * 2^(n-1)) seconds, of which the upper half is random.
+		 * So channels failing at the same time spread their retries.
+		 */
+		class Backoff {
+		public:
+			Backoff(int base, int cap);
+
+			void failure(time_t now);
+			void success();
+
+			const time_t retry_at() const    { return _retry_at; }
+			const unsigned failures() const  { return _failures; }
+
+		private:
+			int _base;
+			int _cap;
+			unsigned _failures;    /**< consecutive failures */
+			time_t _retry_at;      /**< don't send before */
+			unsigned int _seed;
+		}; // class Backoff
+
+		/**
+		 * Circuit breaker for a middleware host
+		 *
+		 * After threshold consecutive failures of any channel of the host, the
+		 * circuit opens and all channels hold their requests for the backoff
+		 * delay. Then a single probe request is let through: if it succeeds
+		 * the circuit closes, otherwise it opens again with a longer delay.
+		 */
+		class Circuit {
+		public:
+			typedef vz::shared_ptr<Circuit> Ptr;
+
+			/**
+			 * Get the shared circuit of the host of url
+			 */
+			static Ptr host(const std::string &url);
+
+			Circuit(const std::string &host, unsigned threshold, int base, int cap);
+			~Circuit();
+
+			/**
+			 * @return false if requests to the host have to wait
+			 */
+			bool allow(time_t now);
+
+			/**
+			 * A request is sent to the host (it might be the probe)
+			 */
+			void attempt();
+
+			/**
+			 * The host answered (even with an error) or could not be reached
+			 */
+			void success();
+			void failure(time_t now);
+
+			/**
+			 * @return end of the open period, 0 if the circuit is closed
+			 */
+			time_t retry_at();
+
+		private:
+			typedef enum {
+				circuit_closed = 0,
+				circuit_open,
+				circuit_half_open
+			} state_t;
+
+			std::string _host;
+			unsigned _threshold;   /**< 0 never opens the circuit */
+			unsigned _failures;    /**< consecutive failures while closed */
+			state_t _state;
+			bool _probing;         /**< probe request is in flight */
+			Backoff _backoff;      /**< delay of the open periods */
+
+			pthread_mutex_t _mutex;
+
+			static std::map<std::string, Ptr> _hosts;
+			static pthread_mutex_t _hosts_mutex;
+		}; // class Circuit
+
+	} // namespace api
+} // namespace vz
+#endif /* _Backoff_hpp_ */
@@ -0,0 +1,101 @@
+/**
+ * Content-Encoding of request bodies
+ *
+ * @copyright Copyright (c) 2011, The volkszaehler.org project
+ * @package vzlogger
+ * @license http://opensource.org/licenses/gpl-license.php GNU Public License
+ */
+/*
+ * This file is part of volkzaehler.org
+ *
+ * volkzaehler.org is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * volkzaehler.org is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _Compression_hpp_
+#define _Compression_hpp_
+
+#include <list>
+#include <string>
+#include <zlib.h>
+#include <curl/curl.h>
+
+#include <Options.hpp>
+
+#define COMPRESSION_DEFAULT_MIN_SIZE 1024   /* bytes, smaller bodies are sent as they are */
+#define COMPRESSION_DEFAULT_LEVEL 6         /* zlib default */
+
+namespace vz {
+	namespace api {
+
+		/**
+		 * Compresses large request bodies with gzip or deflate
+		 *
+		 * Options of the channel:
+		 *   "compression"          "gzip", "deflate" or "none" (default)
+		 *   "compression_min_size" bodies below are not compressed (bytes)
+		 *   "compression_level"    zlib level 1 (fastest) to 9 (best)
+		 *
+		 * The zlib stream is allocated with the first compressed body and
+		 * reset for the following ones.
+		 */
+		class Compression {
+		public:
+			typedef enum {
+				encoding_none = 0,
+				encoding_gzip,
+				encoding_deflate
+			} encoding_t;
+
+			Compression(const std::list<Option> &options);
+			~Compression();
+
+			/**
+			 * Set the body and matching headers of the next request
+			 *
+			 * @param headers request headers without Content-Encoding
+			 * @param body has to live until the request is done
+			 */
+			void post(CURL *curl, struct curl_slist *headers, const std::string &body, const char *name);
+
+			const bool enabled() const { return _encoding != encoding_none; }
+
+			/**
+			 * Same encoding, minimal size and level
+			 */
+			bool operator==(const Compression &other) const;
+
+		private:
+			Compression(const Compression &);
+			Compression &operator=(const Compression &);
+
+			/**
+			 * Deflate body into _buffer
+			 *
+			 * @return false if zlib failed, the body is sent uncompressed then
+			 */
+			bool compress(const std::string &body);
+
+			encoding_t _encoding;
+			size_t _min_size;
+			int _level;
+
+			z_stream _stream;
+			bool _initialized;          /**< _stream has been allocated */
+			std::string _buffer;        /**< compressed body, has to live until the request is done */
+			struct curl_slist *_headers;  /**< request headers with Content-Encoding */
+		}; // class Compression
+
+	} // namespace api
+} // namespace vz
+#endif /* _Compression_hpp_ */
@@ -0,0 +1,102 @@
+/**
+ * Streaming JSON writer for request bodies
+ *
+ * @copyright Copyright (c) 2011, The volkszaehler.org project
+ * @package vzlogger
+ * @license http://opensource.org/licenses/gpl-license.php GNU Public License
+ */
+/*
+ * This file is part of volkzaehler.org
+ *
+ * volkzaehler.org is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * volkzaehler.org is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _JsonWriter_hpp_
+#define _JsonWriter_hpp_
+
+#include <stdint.h>
+#include <string>
+
+#include <Reading.hpp>
+
+#define JSON_WRITER_MAX_DEPTH 63   /* one bit per level in _first */
+
+namespace vz {
+	namespace api {
+
+		/**
+		 * Appends JSON directly to a byte buffer
+		 *
+		 * Request bodies used to be built as json-c object trees with several
+		 * allocations per tuple and stringified afterwards. The writer appends
+		 * to a caller owned string instead, which keeps its capacity between
+		 * requests. Commas are inserted automatically, nesting is limited to
+		 * JSON_WRITER_MAX_DEPTH levels.
+		 *
+		 * json-c is still used to parse responses.
+		 */
+		class JsonWriter {
+		public:
+			/**
+			 * Start writing to buffer, its content is replaced
+			 */
+			JsonWriter(std::string &buffer);
+
+			void begin_array()  { _value(); _buffer += '['; _push(); }
+			void end_array()    { _buffer += ']'; _depth--; }
+			void begin_object() { _value(); _buffer += '{'; _push(); }
+			void end_object()   { _buffer += '}'; _depth--; }
+
+			/**
+			 * Member name, has to be followed by its value
+			 */
+			void key(const char *name);
+
+			void string(const char *str);
+			void number(int64_t value);
+
+			/**
+			 * Shortest representation which reads back to the same double
+			 */
+			void number(double value);
+
+			/**
+			 * Exact decimal mantissa * 10^exponent
+			 */
+			void number(int64_t mantissa, int exponent);
+
+			/**
+			 * [timestamp in ms, value] as expected by the middleware
+			 *
+			 * Exact readings are written in decimal without rounding.
+			 */
+			void tuple(const Reading &rd);
+
+		private:
+			void _value() {
+				if (_depth > 0 && !_key && (_first & (1ULL << _depth)) == 0) _buffer += ',';
+				_first &= ~(1ULL << _depth);
+				_key = false;
+			}
+			void _push() { _depth++; _first |= 1ULL << _depth; }
+
+			std::string &_buffer;
+			unsigned _depth;
+			uint64_t _first;      /**< bit per level, set until its first value has been written */
+			bool _key;            /**< a key has been written, its value follows */
+		}; // class JsonWriter
+
+	} // namespace api
+} // namespace vz
+#endif /* _JsonWriter_hpp_ */
@@ -37,6 +37,8 @@
 #include <Options.hpp>
 #include <api/CurlIF.hpp>
 #include <api/CurlResponse.hpp>
+#include <api/JsonWriter.hpp>
+#include <api/Backoff.hpp>
 #include <Reading.hpp>
 
 namespace vz {
@@ -71,18 +73,23 @@ namespace vz {
 			json_object *_apiDevice(Buffer::Ptr buf);
 	
 			/**
-			 *  api configured as sensor
+			 *  api configured as sensor, streams the request into _body
 			 */
-			json_object *_apiSensor(Buffer::Ptr buf);
+			bool _apiSensor(Buffer::Ptr buf);
 
 			json_object * _json_object_registration();
 			json_object * _json_object_heartbeat();
 			json_object * _json_object_event(Buffer::Ptr buf);
 			json_object * _json_object_sensor(const std::string &sensorName);
-			json_object * _json_object_measurements(Buffer::Ptr buf);
+			bool _json_measurements(Buffer::Ptr buf, JsonWriter &writer);
 
 			void _api_header();
 
+			/**
+			 * Update backoff and circuit with the result of a request
+			 */
+			void _result(CURLcode curl_code, long int http_code);
+
 			void hmac_sha1(char *digest, const unsigned char *data,size_t dataLen);
 
 			CurlResponse *response()   { return _response.get(); }
@@ -106,11 +113,12 @@ namespace vz {
 			
 			CurlIF _curlIF;
 			CurlResponse::Ptr _response;
+			std::string _body;       /**< request body, reused between requests */
+			Backoff _backoff;        /**< delays retries after failed requests */
+			Circuit::Ptr _circuit;   /**< shared by all channels of the middleware host */
 	
-			// Volatil
-			std::list<Reading> _values;
-
 			time_t _first_ts;
+			time_t _batch_ts;        /**< last timestamp of the request in flight */
 			long _first_counter;
 			long _last_counter;
 	
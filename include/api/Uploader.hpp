@@ -0,0 +1,158 @@
+/**
+ * Shared uploader for volkszaehler.org middleware channels
+ *
+ * @author Kai Krueger <kai.krueger@itwm.fraunhofer.de>
+ * @copyright Copyright (c) 2011, The volkszaehler.org project
+ * @package vzlogger
+ * @license http://opensource.org/licenses/gpl-license.php GNU Public License
+ */
+/*
+ * This file is part of volkzaehler.org
+ *
+ * volkzaehler.org is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * volkzaehler.org is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _Uploader_hpp_
+#define _Uploader_hpp_
+
+#include <list>
+#include <pthread.h>
+#include <signal.h>
+#include <curl/curl.h>
+
+#include <Channel.hpp>
+#include <api/Volkszaehler.hpp>
+#include <api/VolkszaehlerBulk.hpp>
+
+#define UPLOADER_MAX_HOST_CONNECTIONS 4   /* parallel connections per middleware host */
+#define UPLOADER_IDLE_TIMEOUT 60          /* seconds to wait for new readings */
+
+namespace vz {
+	namespace api {
+
+		/**
+		 * Drives the uploads of all volkszaehler channels from a single thread
+		 *
+		 * All requests are multiplexed over one curl multi handle. Its connection
+		 * cache is keyed by middleware host, so channels pointing to the same
+		 * middleware reuse a few keep-alive connections instead of opening one
+		 * TCP/TLS session per channel. DNS and TLS sessions are shared as well.
+		 *
+		 * Channels with the "bulk" option are grouped by middleware and
+		 * uploaded with one request per group.
+		 *
+		 * Readings are held back according to the batch policy of each channel
+		 * (batch_size, batch_age, batch_interval) and flushed on shutdown.
+		 */
+		class Uploader {
+		public:
+			static Uploader &instance();
+
+			/**
+			 * Create the api for a channel and attach it to the uploader
+			 *
+			 * Channels have to be added before the uploader is started.
+			 */
+			void add(Channel::Ptr ch);
+
+			void start();
+
+			/**
+			 * Stop the uploader thread and flush all pending readings
+			 */
+			void cancel();
+
+			/**
+			 * Ask the uploader thread to terminate
+			 *
+			 * Only sets a flag and writes to the wakeup pipe, so it is safe to call
+			 * from a signal handler. cancel() joins the thread and flushes.
+			 */
+			void stop();
+
+			/**
+			 * Notify the uploader about new readings
+			 */
+			void wakeup();
+
+			const bool running() const { return _thread_running; }
+			const size_t size() const  { return _uploads.size(); }
+
+		private:
+			/* either a single channel or a bulk group */
+			typedef struct {
+				vz::shared_ptr<Volkszaehler> api;
+				vz::shared_ptr<VolkszaehlerBulk> bulk;
+				VolkszaehlerBulk *group;  /**< bulk group of the channel */
+			} upload_t;
+
+			CURL *handle(upload_t &upload) {
+				return (upload.bulk) ? upload.bulk->curl() : upload.api->curl();
+			}
+			const bool busy(upload_t &upload) {
+				return (upload.bulk) ? upload.bulk->busy() : upload.api->busy();
+			}
+			const time_t retry_at(upload_t &upload) {
+				return (upload.bulk) ? upload.bulk->retry_at() : upload.api->retry_at();
+			}
+			const time_t due_at(upload_t &upload) {
+				return (upload.bulk) ? upload.bulk->due_at() : upload.api->due_at();
+			}
+
+			Uploader();
+			~Uploader();
+
+			/**
+			 * Share connections and map the curl handle back to the upload
+			 */
+			void attach(upload_t &upload);
+
+			static void * thread(void *arg);
+			void run();
+
+			/**
+			 * Add requests for all idle channels with pending readings
+			 *
+			 * @return seconds until the next channel may retry a failed request
+			 */
+			int schedule();
+
+			/**
+			 * Send all pending readings regardless of the batch policy
+			 *
+			 * Each upload gets a single attempt, failed readings stay in the spool.
+			 */
+			void flush();
+
+			/**
+			 * Hand finished requests back to their channels
+			 *
+			 * @return number of finished requests
+			 */
+			int complete();
+
+			CURLM *_multi;
+			CURLSH *_share;
+			int _wakeup[2];                 /**< self-pipe to interrupt curl_multi_wait() */
+
+			std::list<upload_t> _uploads;   /**< stable addresses, used as CURLOPT_PRIVATE */
+
+			volatile sig_atomic_t _stop;    /**< set by stop(), checked by the mainloop */
+			bool _thread_running;
+			pthread_t _thread;
+		}; // class Uploader
+
+	} // namespace api
+} // namespace vz
+#endif /* _Uploader_hpp_ */
@@ -34,12 +34,17 @@
 #define _Volkszaehler_hpp_
 
 #include <stdint.h>
+#include <algorithm>
+#include <vector>
 #include <curl/curl.h>
 #include <json/json.h>
 
 #include <ApiIF.hpp>
 #include <Options.hpp>
 #include "Buffer.hpp"
+#include <api/JsonWriter.hpp>
+#include <api/Compression.hpp>
+#include <api/Backoff.hpp>
 
 namespace vz {
 	namespace api {
@@ -65,21 +70,85 @@ namespace vz {
 
 			void register_device();
 
+			/**
+			 * Build the request for all pending readings
+			 *
+			 * The request can be performed by curl_easy_perform() or a multi handle.
+			 *
+			 * @param flush ignore the batch policy and a pending retry (shutdown)
+			 * @return false if there is nothing to send, the batch is not due or we are waiting to retry
+			 */
+			bool prepare(bool flush = false);
+
+			/**
+			 * Evaluate the response of the request built by prepare()
+			 *
+			 * @return true if the readings have been accepted by the middleware
+			 */
+			bool complete(CURLcode curl_code);
+
+			/**
+			 * Add new readings to the current batch
+			 *
+			 * The batch stays in the channel buffer (or is read from the spool)
+			 * until it is acknowledged by accepted() or rewound by rejected().
+			 *
+			 * @return number of readings in the batch
+			 */
+			size_t collect();
+
+			/**
+			 * Write JSON array of all queued tuples
+			 */
+			void json_tuples(JsonWriter &writer);
+
+			/**
+			 * Release the batch after the middleware accepted it
+			 */
+			void accepted();
+
+			/**
+			 * Rewind the batch after a failed request, it is sent again
+			 */
+			void rejected();
+
+			/**
+			 * Check the batch policy for the queued readings
+			 *
+			 * A batch is sent as soon as it has batch_size readings or its first
+			 * reading has been queued for batch_age seconds, but not earlier than
+			 * batch_interval seconds after the previous request.
+			 */
+			bool due(time_t now);
+
+			/**
+			 * @return time when the queued readings become due, 0 if there are none
+			 */
+			time_t due_at();
+
+			/**
+			 * Remember that the queued readings have been put into a request
+			 */
+			void requested(time_t now) { _last_request = now; }
+
 			const std::string middleware() const { return _middleware; }
+			const char *uuid()                   { return channel()->uuid(); }
+			const char *name()                   { return channel()->name(); }
+			const time_t retry_at()       { return std::max(_backoff.retry_at(), _circuit->retry_at()); }
+			const bool bulk() const       { return _bulk; }
+			const bool busy() const       { return _busy; }
+			const int timeout() const     { return _timeout; }
+			const Compression &compression() const { return _compression; }
+
+			CURL *curl() { return _api.curl; }
       
 		private:
 			std::string _middleware;
 
-			CURL *curl() { return _api.curl; }
 			/**
-			 * Create JSON object of tuples
-			 *
-			 * @param buf	the buffer our readings are stored in (required for mutex)
-			 * @param first	the first tuple of our linked list which should be encoded
-			 * @param last	the last tuple of our linked list which should be encoded
-			 * @return the json_object (has to be free'd)
+			 * Write reading i of the batch unless it is skipped or not newer than last
 			 */
-			json_object * api_json_tuples(Buffer::Ptr buf);
+			void tuple(JsonWriter &writer, const Reading &rd, size_t i, uint64_t &last);
 
       /**
        * Parses JSON encoded exception and stores describtion in err
@@ -89,10 +158,27 @@ namespace vz {
 
 		private:
 			api_handle_t _api;
-
-          // Volatil
-			std::list<Reading> _values;
-          uint64_t _last_timestamp; /**< remember last timestamp */
+			std::string _body;          /**< request body, has to live until the request is done */
+			Compression _compression;
+			CURLresponse _response;
+
+			std::vector<Reading> _spooled; /**< batch read from the spool, preallocated */
+			size_t _queued;             /**< readings in the current batch */
+			bool _from_spool;           /**< current batch has been read from the spool */
+			size_t _skip;               /**< leading readings of the batch the middleware already has */
+			uint64_t _last_timestamp;   /**< last uploaded timestamp, older readings are skipped */
+			uint64_t _batch_timestamp;  /**< last timestamp of the current request */
+			Backoff _backoff;           /**< delays retries after failed requests */
+			Circuit::Ptr _circuit;      /**< shared by all channels of the middleware host */
+			bool _bulk;                 /**< upload together with other channels of this middleware */
+			bool _busy;                 /**< a request of this channel is in flight */
+			int _timeout;
+
+			unsigned int _batch_size;   /**< send as soon as this many readings are queued */
+			int _batch_age;             /**< max. seconds to hold queued readings, 0 for no limit */
+			int _batch_interval;        /**< min. seconds between two requests */
+			time_t _queued_since;       /**< first reading has been queued at, 0 if none */
+			time_t _last_request;
           
 		}; //class Volkszaehler
   
@@ -103,6 +189,11 @@ namespace vz {
 
 		size_t curl_custom_write_callback(void *ptr, size_t size, size_t nmemb, void *data);
 
+		/**
+		 * Initialize a curl handle for the volkszaehler middleware
+		 */
+		void api_init(api_handle_t *api, const char *url, int timeout, Channel *ch);
+
 	} // namespace api
 } // namespace vz
 #endif /* _Volkszaehler_hpp_ */
@@ -0,0 +1,115 @@
+/**
+ * Bulk uploads for the volkszaehler.org middleware
+ *
+ * @author Kai Krueger <kai.krueger@itwm.fraunhofer.de>
+ * @copyright Copyright (c) 2011, The volkszaehler.org project
+ * @package vzlogger
+ * @license http://opensource.org/licenses/gpl-license.php GNU Public License
+ */
+/*
+ * This file is part of volkzaehler.org
+ *
+ * volkzaehler.org is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * volkzaehler.org is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _VolkszaehlerBulk_hpp_
+#define _VolkszaehlerBulk_hpp_
+
+#include <vector>
+#include <curl/curl.h>
+#include <json/json.h>
+
+#include <api/Volkszaehler.hpp>
+
+namespace vz {
+	namespace api {
+
+		/**
+		 * Coalesces the pending tuples of all bulk channels of one middleware
+		 *
+		 * The readings are posted to <middleware>/data.json as
+		 *   [{"uuid": "...", "tuples": [[ts, value], ...]}, ...]
+		 *
+		 * If the middleware rejects a bulk request, the channels fall back to
+		 * single requests for the retry pause, so each channel gets its own
+		 * result (e.g. dropping duplicated tuples) before bulk mode resumes.
+		 */
+		class VolkszaehlerBulk {
+		public:
+			typedef vz::shared_ptr<VolkszaehlerBulk> Ptr;
+
+			VolkszaehlerBulk(const std::string &middleware, int timeout, Channel *ch);
+			~VolkszaehlerBulk();
+
+			/**
+			 * Add a member channel, its compression settings have to match the group
+			 */
+			void add(vz::shared_ptr<Volkszaehler> api);
+
+			/**
+			 * Build one request for the queued tuples of all idle member channels
+			 *
+			 * The request is built once the batch of any member is due, the
+			 * others are sent along with it.
+			 *
+			 * @param flush ignore the batch policy and a pending retry (shutdown)
+			 * @return false if there is nothing to send, no batch is due or we are waiting to retry
+			 */
+			bool prepare(bool flush = false);
+
+			/**
+			 * Map the response back onto the member channels
+			 *
+			 * @return true if the readings have been accepted by the middleware
+			 */
+			bool complete(CURLcode curl_code);
+
+			const std::string middleware() const { return _middleware; }
+			const time_t retry_at()       { return std::max(_backoff.retry_at(), _circuit->retry_at()); }
+			const bool busy() const       { return _busy; }
+			const size_t size() const     { return _members.size(); }
+
+			/**
+			 * @return time when the first member batch becomes due, 0 if none
+			 */
+			time_t due_at();
+
+			/**
+			 * Members send single requests after a rejected bulk request
+			 */
+			const bool split() const      { return _split_until > time(NULL); }
+			const time_t split_until() const { return _split_until; }
+
+			CURL *curl() { return _api.curl; }
+
+		private:
+			std::string _middleware;
+
+			api_handle_t _api;
+			std::string _body;          /**< request body, has to live until the request is done */
+			Compression _compression;   /**< configured by the first channel, shared by all members */
+			CURLresponse _response;
+
+			std::vector<vz::shared_ptr<Volkszaehler> > _members;
+			std::vector<Volkszaehler *> _inflight;  /**< members with tuples in the current request */
+
+			Backoff _backoff;           /**< delays retries after failed requests */
+			Circuit::Ptr _circuit;      /**< shared with the single requests of the members */
+			time_t _split_until;        /**< send single requests until */
+			bool _busy;                 /**< the bulk request is in flight */
+		}; // class VolkszaehlerBulk
+
+	} // namespace api
+} // namespace vz
+#endif /* _VolkszaehlerBulk_hpp_ */
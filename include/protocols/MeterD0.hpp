@@ -32,6 +32,7 @@
 #define D0_BUFFER_LENGTH 1024
 
 #include <termios.h>
+#include <vector>
 
 #include <protocols/Protocol.hpp>
 
@@ -44,6 +45,9 @@ public:
 	int close();
 	ssize_t read(std::vector<Reading> &rds, size_t n);
 
+	int fd() const { return _fd; }
+	ssize_t feed(const char *data, size_t len, std::vector<Reading> &rds, size_t n);
+
 	const char *host() const { return _host.c_str(); }
 	const char *device() const { return _device.c_str(); }
 
@@ -64,6 +68,37 @@ private:
 	 */
 	int _openSocket(const char *node, const char *service);
 	int _openDevice(struct termios *old_tio, speed_t baudrate);
+
+	/**
+	 * Resumable telegram parser
+	 *
+	 * Consumes bytes until the end of a telegram ("!") and keeps its state
+	 * between calls, so a telegram may be split across any number of chunks.
+	 * Readings are stored in rds as soon as their line is complete.
+	 *
+	 * @param complete set to true if a telegram has been finished
+	 * @return number of bytes consumed
+	 */
+	size_t _parse(const char *data, size_t len, std::vector<Reading> &rds, size_t n, bool *complete);
+
+	typedef enum {
+		START, VENDOR, BAUDRATE, IDENTIFICATION, START_LINE, OBIS_CODE, VALUE, UNIT, END_LINE, END
+	} context_t;
+
+	/* parser state */
+	context_t _context;
+	char _vendor[3+1];          /* 3 upper case vendor + '\0' termination */
+	char _identification[16+1]; /* 16 meter specific + '\0' termination */
+	char _obis_code[16+1];      /* A-B:C.D.E*F, see DIN-EN-62056-61 */
+	char _value[32+1];          /* value, i.e. the actual reading */
+	char _unit[16+1];           /* the unit of the value, e.g. kWh, V, ... */
+	char _baudrate_id;          /* baudrate identification of the telegram header */
+	size_t _byte_iterator;
+	size_t _tuples;             /* readings of the current telegram */
+
+	char _buffer[D0_BUFFER_LENGTH]; /* read() buffer */
+	size_t _pos, _len;
+	std::vector<char> _pending; /* bytes fed after the end of a telegram */
 };
 
 #endif /* _D0_H_ */
@@ -26,8 +26,25 @@
 #ifndef _EXEC_H_
 #define _EXEC_H_
 
+#include <sys/types.h>
+#include <time.h>
+
 #include <protocols/Protocol.hpp>
+#include <LineReader.hpp>
+#include <LineFormat.hpp>
+
+#define EXEC_DEFAULT_TIMEOUT 10   /* seconds a command may run */
+#define EXEC_DEFAULT_INTERVAL 10  /* seconds between single runs without interval */
+#define EXEC_KILL_GRACE 1         /* seconds between SIGTERM and SIGKILL */
 
+/**
+ * Runs a command and parses each line it prints
+ *
+ * The command is driven by the MeterReactor: deadline() starts it at each
+ * multiple of the interval (or restarts a persistent one), its stdout is
+ * watched and parsed by feed(). Overdue commands are terminated and
+ * reaped from timeout() without blocking the reactor.
+ */
 class MeterExec : public vz::protocol::Protocol {
 
 public:
@@ -38,9 +55,52 @@ public:
 	int close();
 	ssize_t read(std::vector<Reading> &rds, size_t n);
 
+	int fd() const { return _fd; }
+	ssize_t feed(const char *data, size_t len, std::vector<Reading> &rds, size_t n);
+	ssize_t eof(std::vector<Reading> &rds, size_t n);
+	time_t deadline() const;
+	void timeout();
+
+	const char *command() const { return _command.c_str(); }
+
   private:
-	const char *_command;
-	const char *_format;
+	/**
+	 * Start the command with its stdout connected to _fd
+	 */
+	int _spawn();
+
+	/**
+	 * Collect the exit status of the command if it has terminated
+	 *
+	 * @return true if the command has been reaped
+	 */
+	bool _reap();
+
+	/**
+	 * Signal an overdue command, SIGTERM first and SIGKILL after the grace period
+	 */
+	void _kill(time_t now);
+
+	/**
+	 * Clean up after the command exited and closed its output
+	 */
+	void _finish(time_t now);
+
+  private:
+	std::string _command;
+	LineFormat _format;
+	int _timeout;         /* seconds, 0 to wait forever */
+	int _interval;
+	bool _persistent;     /* keep the command running and read its output continuously */
+
+	pid_t _pid;           /* process group of the command or -1 */
+	bool _exited;         /* command has been reaped, its output may still be open */
+	int _signal;          /* last signal sent to the command */
+	int _fd;              /* read end of its stdout */
+	LineReader _reader;
+	time_t _last;         /* last start of the command */
+	time_t _next;         /* next start of the command, 0 while it is running */
+	time_t _deadline;     /* next check of the running command, 0 if none */
 };
 
 #endif /* _EXEC_H_ */
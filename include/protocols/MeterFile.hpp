@@ -26,7 +26,10 @@
 #ifndef _FILE_H_
 #define _FILE_H_
 
+#include <stdint.h>
 #include <protocols/Protocol.hpp>
+#include <LineReader.hpp>
+#include <LineFormat.hpp>
 
 class MeterFile : public vz::protocol::Protocol {
 
@@ -39,14 +42,34 @@ public:
 	ssize_t read(std::vector<Reading> &rds, size_t n);
 
 	const char *path() { return _path.c_str(); }
-	const char *format() { return _format.c_str(); }
+	const char *format() { return _format.format().c_str(); }
   
   private:
+	/**
+	 * Block until the file has been written, moved or recreated
+	 *
+	 * @param mask inotify events of the file to wait for
+	 */
+	void _wait(uint32_t mask);
+
+	/**
+	 * Check if the path refers to another file than the opened one (rotation)
+	 */
+	bool _replaced();
+	int _reopen();
+
 	std::string _path;
-	std::string _format;
+	LineFormat _format;   /* compiled format of a line */
 	int _rewind;
+	int _interval;        /* poll every interval seconds, -1 to wait for changes with inotify */
+
+	int _fd;
+	LineReader _reader;
+	bool _changed;        /* file has to be read again (rewind) */
 
-	FILE *_fd;
+	int _inotify;         /* inotify instance, -1 if the file has to be polled */
+	int _watch_file;      /* watch descriptor of the opened file */
+	int _watch_dir;       /* watch descriptor of its directory, notices recreated files */
 };
 
 #endif /* _FILE_H_ */
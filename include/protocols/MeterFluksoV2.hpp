@@ -27,6 +27,7 @@
 #define _FLUKSOV2_H_
 
 #include <protocols/Protocol.hpp>
+#include <LineReader.hpp>
 
 class MeterFluksoV2 : public vz::protocol::Protocol {
 
@@ -38,12 +39,21 @@ public:
 	int close();
 	ssize_t read(std::vector<Reading> &rds, size_t n);
 
+	int fd() const { return _fd; }
+	ssize_t feed(const char *data, size_t len, std::vector<Reading> &rds, size_t n);
+
   private:
-	ssize_t _read_line(int fd, char  *buffer, size_t n);
+	/**
+	 * Parse a NUL terminated line into readings starting at rds[i]
+	 *
+	 * @return index following the last reading
+	 */
+	size_t _parse_line(char *line, std::vector<Reading> &rds, size_t i, size_t n);
   
   private:
 	const char *_fifo;
 	int _fd;	/* file descriptor of fifo */
+	LineReader _reader;	/* buffers incomplete lines */
 
 	//const char *DEFAULT_FIFO = "/var/run/spid/delta/out";
 	const char *_DEFAULT_FIFO;
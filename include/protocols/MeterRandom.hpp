@@ -40,6 +40,8 @@ public:
 	int close();
 	ssize_t read(std::vector<Reading> &rds, size_t n);
 
+	bool scheduled() const { return true; }
+
 protected:
 	double _min;
 	double _max;
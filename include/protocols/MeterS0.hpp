@@ -22,14 +22,38 @@
  * You should have received a copy of the GNU General Public License
  * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
  */
- 
 #ifndef _S0_H_
 #define _S0_H_
 
+#define S0_QUEUE_LENGTH 1024      /* pulses, has to be a power of two */
+#define S0_MAX_INPUTS 16
+#define S0_DEFAULT_DEBOUNCE 30    /* ms */
+#define S0_DEFAULT_WINDOW 4       /* pulse intervals averaged for the power */
+
 #include <termios.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <string>
+#include <vector>
 
 #include <protocols/Protocol.hpp>
 
+/**
+ * S0 pulse meter
+ *
+ * Pulses are captured by a dedicated thread from one of
+ *  - the rx line of a tty, each received byte is a pulse
+ *  - the modem status lines of a tty (cts, dsr, dcd, ri), up to four inputs
+ *  - the edges of one or more sysfs gpios
+ * All inputs of a meter are served by this single thread. Pulses are
+ * timestamped with CLOCK_MONOTONIC and passed through a lock-free single
+ * producer/single consumer queue. The consumer debounces them from their
+ * timestamps and derives the power from a rolling window of pulse
+ * intervals, so no pulse is lost while the readings are processed.
+ *
+ * Input n reports its power as ChannelIdentifier(n + 1) and its number of
+ * pulses as ChannelIdentifier(-(n + 1)), like the sensors of the Flukso.
+ */
 class MeterS0 : public vz::protocol::Protocol {
 
 public:
@@ -40,17 +64,86 @@ public:
 	int close();
 	ssize_t read(std::vector<Reading> &rds, size_t n);
 
+	/* woken by the capture thread */
+	int fd() const { return _event; }
+	ssize_t feed(const char *data, size_t len, std::vector<Reading> &rds, size_t n);
+
   private:
-	int _open_socket(const char *node, const char *service);
+	typedef enum {
+		capture_rx,       /* bytes received by the tty */
+		capture_lines,    /* modem status lines */
+		capture_gpio      /* sysfs gpios */
+	} capture_t;
+
+	typedef struct {
+		/* capture thread */
+		int source;       /* gpio number or modem status bit (TIOCM_*) */
+		int fd;           /* gpio value */
+		uint32_t edges;   /* transitions counted by the uart */
+		bool level;
+
+		/* consumer */
+		int64_t counter;
+		uint64_t last;    /* last accepted pulse */
+		size_t accepted;
+		bool pulsed;      /* readings are due */
+		std::vector<uint64_t> pulses;  /* last accepted pulses, ring of _window + 1 */
+	} input_t;
+
+	typedef struct {
+		uint64_t ns;
+		uint32_t input;
+		uint32_t count;   /* pulses counted by the uart are not debounced, else 0 */
+	} pulse_t;
+
 	int _open_device(struct termios *old_tio, speed_t baudrate);
+	int _open_gpio(int gpio);
+	int _open_inputs();
+	void _close_inputs();
+
+	static void * _capture_thread(void *arg);
+	void _capture();
+	int _capture_rx();
+	int _capture_lines();
+	int _capture_gpio();
+
+	/**
+	 * Append a pulse to the queue (producer)
+	 *
+	 * @param count number of transitions already counted by the uart, these
+	 *              share one timestamp and skip the debounce
+	 */
+	void _push(uint64_t ns, size_t input, uint32_t count = 0);
+
+	/**
+	 * Debounce queued pulses and store counter and power of each input (consumer)
+	 *
+	 * @return number of readings stored
+	 */
+	size_t _drain(std::vector<Reading> &rds, size_t n);
 
   protected:
-	const char *_device;
+	std::string _device;
+	capture_t _mode;
+	bool _icount;             /* uart counts the transitions of the modem lines */
 	int _resolution;
-	int _counter;
+	uint64_t _debounce;       /* ns */
+	size_t _window;
 
 	int _fd;	/* file descriptor of port */
 	struct termios _old_tio;	/* required to reset port */
+	int _event;               /* eventfd signalled for new pulses */
+	std::vector<input_t> _inputs;
+
+	bool _thread_running;
+	pthread_t _thread;
+
+	/* pulse queue, _head is written by the capture thread only, _tail by the consumer */
+	pulse_t _queue[S0_QUEUE_LENGTH];
+	volatile size_t _head;
+	volatile size_t _tail;
+	volatile size_t _overflows;
+	size_t _overflows_seen;
 };
 
 #endif /* _S0_H_ */
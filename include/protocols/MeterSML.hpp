@@ -34,6 +34,7 @@
 #include <sml/sml_value.h>
 
 #include <termios.h>
+#include <vector>
 
 #include <protocols/Protocol.hpp>
 #include "Obis.hpp"
@@ -51,6 +52,9 @@ public:
 	int close();
 	ssize_t read(std::vector<Reading> &rds, size_t n);
 
+	int fd() const { return _fd; }
+	ssize_t feed(const char *data, size_t len, std::vector<Reading> &rds, size_t n);
+
 	const char *host() const { return _host.c_str(); }
 	const char *device() const { return _device.c_str(); }
   
@@ -64,13 +68,56 @@ protected:
 
 	const int BUFFER_LEN;
 
+	std::vector<unsigned char> _buffer;	/* receive buffer, kept between datagrams */
+	size_t _begin;	/* first byte not consumed yet */
+	size_t _start;	/* payload of the current frame, SML_NO_FRAME if searching a start sequence */
+	size_t _scan;	/* next 4 byte block of the frame to check */
+	size_t _out;	/* end of the unescaped payload */
+	size_t _end;	/* end of received data */
+
+	/**
+	 * Find the next complete transport frame in the receive buffer
+	 *
+	 * Escaped escape sequences are removed in place, the payload stays
+	 * valid until more data is received.
+	 *
+	 * @return true if a frame has been completed
+	 */
+	bool _frame(unsigned char **payload, size_t *len);
+
+	/**
+	 * Move unconsumed data to the front of the receive buffer
+	 *
+	 * @return free space at the end
+	 */
+	size_t _compact();
+
+	/**
+	 * Parse the payload of a frame and store list entries in rds
+	 *
+	 * @return number of readings
+	 */
+	size_t _parse_file(unsigned char *payload, size_t len, std::vector<Reading> &rds, size_t n);
+
+	/**
+	 * Native decoder for files with GetListResponse messages
+	 *
+	 * Decodes list entries straight from the payload into the reading
+	 * slots and checks the CRC of each message, nothing is allocated.
+	 *
+	 * @param m number of readings stored
+	 * @return false if the file has to be parsed by libsml
+	 */
+	bool _decode(const unsigned char *payload, size_t len, std::vector<Reading> &rds, size_t n, size_t *m);
+
 	/**
 	 * Parses SML list entry and stores it in reading pointed by rd
 	 *
 	 * @param list the list entry
 	 * @param rd the reading to store to
+	 * @return false if the entry has no valid OBIS code or value
 	 */
-	void _parse(sml_list *list, Reading *rd);
+	bool _parse(sml_list *list, Reading *rd);
 
 	/**
 	 * Open serial port by device
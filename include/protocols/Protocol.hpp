@@ -30,6 +30,7 @@
 
 #include <vector>
 #include <list>
+#include <time.h>
 
 #include <common.h>
 #include <shared_ptr.hpp>
@@ -50,6 +51,60 @@ namespace vz {
 			virtual int    close() = 0;
 			virtual ssize_t read(std::vector<Reading> &rds, size_t n) = 0;
 
+			/**
+			 * File descriptor for event driven protocols
+			 *
+			 * Protocols returning a descriptor after open() are driven by the
+			 * MeterReactor: the descriptor is switched to non-blocking mode
+			 * and everything readable is passed to feed(). read() is not used then.
+			 *
+			 * @return descriptor or -1 if the protocol has to be polled by read()
+			 */
+			virtual int fd() const { return -1; }
+
+			/**
+			 * Parse a chunk of bytes read from fd()
+			 *
+			 * Incomplete messages have to be kept by the protocol until the next chunk.
+			 * Protocols may stop after a complete message and keep the remaining
+			 * bytes, they are called again with an empty chunk to continue.
+			 *
+			 * @return number of readings completed (at most n), <0 on error
+			 */
+			virtual ssize_t feed(const char *data, size_t len, std::vector<Reading> &rds, size_t n) {
+				return -1;
+			}
+
+			/**
+			 * End of data on fd()
+			 *
+			 * Protocols expecting the end of their data (e.g. a finished command)
+			 * complete the remaining readings and close the descriptor. Otherwise
+			 * the meter is closed and reopened by the MeterReactor.
+			 *
+			 * @return number of readings completed (at most n), <0 to reopen the meter
+			 */
+			virtual ssize_t eof(std::vector<Reading> &rds, size_t n) { return -1; }
+
+			/**
+			 * Next call of timeout() by the MeterReactor
+			 *
+			 * Protocols driven by timers are added to the MeterReactor even
+			 * without a descriptor, fd() is watched as soon as it is valid.
+			 *
+			 * @return 0 if no timer is pending
+			 */
+			virtual time_t deadline() const { return 0; }
+			virtual void timeout() {}
+
+			/**
+			 * Protocols returning true are polled by the MeterScheduler
+			 *
+			 * read() is called at each multiple of the meter interval and has to
+			 * return the current readings instead of waiting for the next interval.
+			 */
+			virtual bool scheduled() const { return false; }
+
 			const std::string &name() { return _name; }
     
 		private:
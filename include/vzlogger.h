@@ -35,6 +35,8 @@
 
 using namespace std;
 
+#define STOP_CHECK_INTERVAL 1   /* seconds between checks for terminated meters */
+
 /* prototypes */
 void quit(int sig);
 void daemonize();
@@ -0,0 +1,175 @@
+/**
+ * Per channel aggregation of readings
+ *
+ * Readings of a channel are combined into one reading per time window
+ * before they are buffered, spooled and uploaded.
+ *
+ * @copyright Copyright (c) 2011, The volkszaehler.org project
+ * @package vzlogger
+ * @license http://opensource.org/licenses/gpl-license.php GNU Public License
+ */
+/*
+ * This file is part of volkzaehler.org
+ *
+ * volkzaehler.org is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * volkzaehler.org is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "Aggregator.hpp"
+#include <VZException.hpp>
+#include <common.h>
+
+#define AGGREGATOR_DEFAULT_PERIOD 60   /* seconds */
+
+Aggregator::Aggregator(const std::list<Option> &options)
+		: _type(aggregate_none)
+		, _period(AGGREGATOR_DEFAULT_PERIOD)
+		, _delta(false)
+		, _window(0)
+		, _count(0)
+		, _sum(0)
+		, _has_previous(false)
+{
+	OptionList optlist;
+
+	try {
+		const char *type = optlist.lookup_string(options, "aggregation");
+
+		if (strcmp(type, "mean") == 0)      _type = aggregate_mean;
+		else if (strcmp(type, "min") == 0)  _type = aggregate_min;
+		else if (strcmp(type, "max") == 0)  _type = aggregate_max;
+		else if (strcmp(type, "last") == 0) _type = aggregate_last;
+		else if (strcmp(type, "none") != 0) {
+			print(log_error, "Invalid aggregation '%s'", NULL, type);
+			throw vz::VZException("Invalid aggregation.");
+		}
+	} catch (vz::OptionNotFoundException &e) {
+		/* pass readings through */
+	} catch (vz::VZException &e) {
+		print(log_error, "Failed to parse aggregation", NULL);
+		throw;
+	}
+
+	try {
+		_period = optlist.lookup_int(options, "aggregation_period");
+	} catch (vz::OptionNotFoundException &e) {
+		/* use default */
+	} catch (vz::VZException &e) {
+		print(log_error, "Failed to parse aggregation_period", NULL);
+		throw;
+	}
+	if (_period < 1) throw vz::VZException("Aggregation period must be greater than 0.");
+
+	try {
+		_delta = optlist.lookup_bool(options, "delta");
+	} catch (vz::OptionNotFoundException &e) {
+		/* absolute values */
+	} catch (vz::VZException &e) {
+		print(log_error, "Failed to parse delta", NULL);
+		throw;
+	}
+}
+
+bool Aggregator::push(const Reading &rd, Reading &out) {
+	bool completed = false;
+
+	if (_type == aggregate_none) { /* delta encoding only */
+		_result = rd;
+		_count = 1;
+		return _complete(out);
+	}
+
+	time_t window = rd.tv().tv_sec - rd.tv().tv_sec % _period;
+	if (_count > 0 && window != _window) {
+		completed = _complete(out);
+	}
+
+	if (_count == 0) { /* start a new window */
+		_window = window;
+		_sum = 0;
+	}
+
+	switch (_type) {
+			case aggregate_min:
+				if (_count == 0 || rd.value() < _result.value()) _result = rd;
+				break;
+
+			case aggregate_max:
+				if (_count == 0 || rd.value() > _result.value()) _result = rd;
+				break;
+
+			default: /* mean, last */
+				_result = rd;
+				break;
+	}
+
+	_sum += rd.value();
+	_last = rd.tv();
+	_count++;
+
+	return completed;
+}
+
+bool Aggregator::flush(Reading &out) {
+	if (_type == aggregate_none || _count == 0) {
+		return false; /* delta encoding emits immediately */
+	}
+
+	return _complete(out);
+}
+
+bool Aggregator::_complete(Reading &out) {
+	Reading aggregate = _result;
+
+	if (_type == aggregate_mean) {
+		aggregate.value(_sum / _count);
+	}
+	if (_type != aggregate_none) {
+		aggregate.time(_last); /* end of the window */
+	}
+	_count = 0;
+
+	if (!_delta) {
+		out = aggregate;
+		return true;
+	}
+
+	/* the first aggregate is only the base of the delta */
+	bool ready = _has_previous;
+	if (ready) {
+		out = aggregate;
+
+		if (aggregate.exact() && _previous.exact() && aggregate.exponent() == _previous.exponent()) {
+			out.value(aggregate.mantissa() - _previous.mantissa(), aggregate.exponent());
+		}
+		else {
+			out.value(aggregate.value() - _previous.value());
+		}
+	}
+
+	_previous = aggregate;
+	_has_previous = true;
+
+	return ready;
+}
+
+/*
+ * Local variables:
+ *  tab-width: 2
+ *  c-indent-level: 2
+ *  c-basic-offset: 2
+ *  project-name: vzlogger
+ * End:
+ */
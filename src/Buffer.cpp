@@ -1,5 +1,5 @@
 /**
- * Circular buffer (double linked)
+ * Circular buffer (lock-free single producer/single consumer ring)
  *
  * Used to store recent readings and buffer in case of net inconnectivity
  *
@@ -28,44 +28,51 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <algorithm>
 
 #include "Buffer.hpp"
-
-Buffer::Buffer() :
-		_keep(32)
+#include <common.h>
+
+Buffer::Buffer(size_t capacity) :
+		_mask(0)
+		, _head(0)
+		, _tail(0)
+		, _sent(0)
+		, _dropped(0)
+		, _newValues(false)
+		, _keep(32)
 {
 	pthread_mutex_init(&_mutex, NULL);
+	_resize(capacity);
 }
 
 void Buffer::push(const Reading &rd) {
-	lock();
+	size_t head = _head;
+
+	if (head - _tail > _mask) { /* ring is full, consumer did not keep up */
+		if (_dropped++ % capacity() == 0) {
+			print(log_warning, "Buffer full, dropped %lu readings", NULL, (unsigned long) _dropped);
+		}
+		return;
+	}
+
+	_ring[head & _mask] = rd;
+	__sync_synchronize(); /* publish slot before moving the cursor */
+	_head = head + 1;
+
 	have_newValues();
-	_sent.push_back(rd);
-	unlock();
 }
 
 void Buffer::clean() {
 	lock();
-	for(iterator it = _sent.begin(); it!= _sent.end(); it++) {
-		if(it->deleted()) {
-			if( it == _sent.begin() ){
-				_sent.erase(it);
-				it = _sent.begin();
-			} else {
-				it = _sent.erase(it);
-			}
-		}
-
-	}
-//_sent.clear();
+	__sync_synchronize(); /* finish reading slots before releasing them to the producer */
+	_tail = _sent;
 	unlock();
 }
 
 void Buffer::undelete() {
 	lock();
-	for(iterator it = _sent.begin(); it!= _sent.end(); it++) {
-		it->reset();
-	}
+	_sent = _tail;
 	unlock();
 }
 
@@ -73,10 +80,37 @@ void Buffer::undelete() {
 void Buffer::shrink(/*size_t keep*/) {
 	lock();
 
-//	while(size > keep && begin() != sent) {
-//		pop();
-//	}
+	size_t head = _head;
+	if (head - _tail > _keep) {
+		__sync_synchronize();
+		_tail = head - _keep;
+		if (_sent - _tail > head - _tail) { /* sent cursor has been dropped */
+			_sent = _tail;
+		}
+	}
+
+	unlock();
+}
+
+void Buffer::keep(const size_t keep) {
+	_keep = std::min(keep, (size_t) BUFFER_MAX_CAPACITY / 2);
 
+	if (_keep * 2 > capacity()) { /* leave room for readings pushed before the next shrink() */
+		_resize(_keep * 2);
+	}
+}
+
+void Buffer::_resize(size_t n) {
+	size_t capacity = 1;
+	while (capacity < n) capacity <<= 1; /* round up to power of two */
+
+	lock();
+	std::vector<Reading> ring(capacity);
+	for (size_t pos = _tail; pos != _head; pos++) {
+		ring[pos & (capacity - 1)] = _ring[pos & _mask];
+	}
+	_ring.swap(ring);
+	_mask = capacity - 1;
 	unlock();
 }
 
@@ -85,18 +119,18 @@ char * Buffer::dump(char *dump, size_t len) {
 	dump[pos++] = '{';
 
 	lock();
-	for(iterator it = _sent.begin(); it!= _sent.end(); it++) {
+	for(iterator it = begin(); it!= end(); it++) {
 		if (pos < len) {
 			pos += snprintf(dump+pos, len-pos, "%.4f", it->value());
 		}
 
 		/* indicate last sent reading */
-		if (pos < len && _sent.end() == it) {
+		if (pos < len && _sent - 1 == it._pos) {
 			dump[pos++] = '!';
 		}
 
 		/* add seperator between values */
-		if (pos < len && it != _sent.end()) {
+		if (pos < len && it != end()) {
 			dump[pos++] = ',';
 		}
 	}
@@ -31,6 +31,7 @@
 #include <stdio.h>
 
 #include "Channel.hpp"
+#include <common.h>
 
 int Channel::instances = 0;
 
@@ -38,11 +39,12 @@ Channel::Channel(
 	const std::list<Option> &pOptions,
 	const std::string apiProtocol,
 	const std::string uuid,
-	ReadingIdentifier::Ptr pIdentifier
+	const ReadingIdentifier &pIdentifier
 	)
 		: _thread_running(false)
 		, _options(pOptions)
 		, _buffer(new Buffer())
+		, _spool_failed(false)
 		, _identifier(pIdentifier)
 		, _last(0)
 		, _uuid(uuid)
@@ -55,6 +57,16 @@ Channel::Channel(
 	oss<<"chn"<< id;
 	_name=oss.str();
 
+	Aggregator::Ptr aggregator(new Aggregator(pOptions));
+	if (aggregator->enabled()) {
+		_aggregator = aggregator;
+	}
+
+	Deadband::Ptr deadband(new Deadband(pOptions));
+	if (deadband->enabled()) {
+		_deadband = deadband;
+	}
+
 	pthread_cond_init(&condition, NULL); /* initialize thread syncronization helpers */
 }
 
@@ -65,6 +77,49 @@ Channel::~Channel() {
 	pthread_cond_destroy(&condition);
 }
 
+void Channel::push(const Reading &rd) {
+	Reading aggregate;
+
+	if (!_aggregator) {
+		_store(rd);
+	}
+	else if (_aggregator->push(rd, aggregate)) {
+		_store(aggregate);
+	} /* else window not completed yet */
+}
+
+void Channel::flush() {
+	Reading aggregate;
+
+	if (_aggregator && _aggregator->flush(aggregate)) {
+		_store(aggregate);
+	}
+}
+
+void Channel::_store(const Reading &rd) {
+	Reading filtered[2];
+	const Reading *out = &rd;
+	size_t n = 1;
+
+	if (_deadband) {
+		n = _deadband->push(*out, filtered);
+		out = filtered;
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		if (_spool && !_spool_failed) {
+			try {
+				_spool->append(out[i]); /* write through */
+			} catch (vz::VZException &e) {
+				/* spooled readings stay on disk and are sent after a restart */
+				print(log_error, "Cannot append to spool, buffering in memory: %s", name(), e.what());
+				_spool_failed = true;
+			}
+		}
+		_buffer->push(out[i]);
+	}
+}
+
 
 /*
  * Local variables:
@@ -29,6 +29,7 @@
 
 #include <Config_Options.hpp>
 #include "Channel.hpp"
+#include "Spool.hpp"
 #include <VZException.hpp>
 
 
@@ -42,6 +43,12 @@ Config_Options::Config_Options()
     , _comet_timeout(30)
     , _buffer_length(600)
     , _retry_pause(15)
+    , _retry_max(600)
+    , _breaker(5)
+    , _spool("")
+    , _spool_size(1024)
+    , _spool_sync(Spool::sync_interval)
+    , _spool_sync_interval(60)
     , _daemon(false)
     , _foreground(false)
     , _local(false)
@@ -60,6 +67,12 @@ Config_Options::Config_Options(
     , _comet_timeout(30)
     , _buffer_length(600)
     , _retry_pause(15)
+    , _retry_max(600)
+    , _breaker(5)
+    , _spool("")
+    , _spool_size(1024)
+    , _spool_sync(Spool::sync_interval)
+    , _spool_sync_interval(60)
     , _daemon(false)
     , _foreground(false)
     , _local(false)
@@ -120,6 +133,12 @@ void Config_Options::config_parse(
       else if (strcmp(key, "retry") == 0 && type == json_type_int) {
         _retry_pause = json_object_get_int(value);
       }
+      else if (strcmp(key, "retry_max") == 0 && type == json_type_int) {
+        _retry_max = json_object_get_int(value);
+      }
+      else if (strcmp(key, "breaker") == 0 && type == json_type_int) {
+        _breaker = json_object_get_int(value);
+      }
       else if (strcmp(key, "verbosity") == 0 && type == json_type_int) {
         _verbosity = json_object_get_int(value);
       }
@@ -148,6 +167,34 @@ void Config_Options::config_parse(
           }
         }
       }
+      else if (strcmp(key, "spool") == 0) {
+        json_object_object_foreach(value, key, spool_value) {
+          enum json_type spool_type = json_object_get_type(spool_value);
+
+          if (strcmp(key, "path") == 0 && spool_type == json_type_string) {
+            _spool = json_object_get_string(spool_value);
+          }
+          else if (strcmp(key, "size") == 0 && spool_type == json_type_int) {
+            _spool_size = json_object_get_int(spool_value);
+          }
+          else if (strcmp(key, "sync") == 0 && spool_type == json_type_int) {
+            _spool_sync = Spool::sync_interval;
+            _spool_sync_interval = json_object_get_int(spool_value);
+          }
+          else if (strcmp(key, "sync") == 0 && spool_type == json_type_string &&
+                   strcmp(json_object_get_string(spool_value), "always") == 0) {
+            _spool_sync = Spool::sync_always;
+          }
+          else if (strcmp(key, "sync") == 0 && spool_type == json_type_string &&
+                   strcmp(json_object_get_string(spool_value), "never") == 0) {
+            _spool_sync = Spool::sync_never;
+          }
+          else {
+            print(log_error, "Ignoring invalid field or type: %s=%s (%s)",
+                  NULL, key, json_object_get_string(spool_value), option_type_str[spool_type]);
+          }
+        }
+      }
       else if ((strcmp(key, "sensors") == 0 || strcmp(key, "meters") == 0) && type == json_type_array) {
         int len = json_object_array_length(value);
         for (int i = 0; i < len; i++) {
@@ -253,9 +300,8 @@ void Config_Options::config_parse_channel(Json &jso, MeterMap &mapping)
     throw vz::VZException("Invalid UUID.");
   }
   // check if identifier is set. If not, use default
-  if( id_str == NULL ) {
+  if( id_str == NULL ) { /* nil matches any reading of the meter */
     print(log_error, "Identifier is not set. Set it to default value 'NilItentifier'.", NULL);
-    id_str = "NilItentifier";
   }
 //if (middleware == NULL) {
 //print(log_error, "Missing middleware", NULL);
@@ -266,7 +312,7 @@ void Config_Options::config_parse_channel(Json &jso, MeterMap &mapping)
   }
 
 /* parse identifier */
-  ReadingIdentifier::Ptr id;
+  ReadingIdentifier id;
   try {
     if( id_str != NULL ) {
       id = reading_id_parse(mapping.meter()->protocolId(), (const char *)id_str);
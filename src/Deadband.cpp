@@ -0,0 +1,106 @@
+/**
+ * Per channel deadband filter
+ *
+ * @copyright Copyright (c) 2011, The volkszaehler.org project
+ * @package vzlogger
+ * @license http://opensource.org/licenses/gpl-license.php GNU Public License
+ */
+/*
+ * This file is part of volkzaehler.org
+ *
+ * volkzaehler.org is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * volkzaehler.org is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <algorithm>
+
+#include "Deadband.hpp"
+#include <VZException.hpp>
+#include <common.h>
+
+Deadband::Deadband(const std::list<Option> &options)
+		: _absolute(-1)
+		, _relative(-1)
+		, _heartbeat(DEADBAND_DEFAULT_HEARTBEAT)
+		, _has_last(false)
+		, _has_held(false)
+{
+	OptionList optlist;
+
+	try {
+		_absolute = optlist.lookup_double(options, "deadband");
+		if (_absolute < 0) throw vz::VZException("Deadband must not be negative.");
+	} catch (vz::OptionNotFoundException &e) {
+		/* unused */
+	} catch (vz::VZException &e) {
+		print(log_error, "Failed to parse deadband", NULL);
+		throw;
+	}
+
+	try {
+		_relative = optlist.lookup_double(options, "deadband_relative");
+		if (_relative < 0) throw vz::VZException("Relative deadband must not be negative.");
+	} catch (vz::OptionNotFoundException &e) {
+		/* unused */
+	} catch (vz::VZException &e) {
+		print(log_error, "Failed to parse deadband_relative", NULL);
+		throw;
+	}
+
+	try {
+		_heartbeat = optlist.lookup_int(options, "heartbeat");
+		if (_heartbeat < 0) throw vz::VZException("Heartbeat must not be negative.");
+	} catch (vz::OptionNotFoundException &e) {
+		/* use default */
+	} catch (vz::VZException &e) {
+		print(log_error, "Failed to parse heartbeat", NULL);
+		throw;
+	}
+}
+
+size_t Deadband::push(const Reading &rd, Reading *out) {
+	size_t n = 0;
+
+	if (_has_last) {
+		double band = std::max(_absolute, _relative * fabs(_last.value()));
+		bool changed = fabs(rd.value() - _last.value()) > band;
+		bool due = _heartbeat > 0 && rd.tv().tv_sec - _last.tv().tv_sec >= _heartbeat;
+
+		if (!changed && !due) {
+			_held = rd;
+			_has_held = true;
+			return 0;
+		}
+
+		if (changed && _has_held) { /* end of the plateau */
+			out[n++] = _held;
+		}
+	}
+
+	out[n++] = rd;
+	_last = rd;
+	_has_last = true;
+	_has_held = false;
+
+	return n;
+}
+
+/*
+ * Local variables:
+ *  tab-width: 2
+ *  c-indent-level: 2
+ *  c-basic-offset: 2
+ *  project-name: vzlogger
+ * End:
+ */
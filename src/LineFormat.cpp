@@ -0,0 +1,161 @@
+/**
+ * Compiled format for parsing readings from text lines
+ *
+ * @copyright Copyright (c) 2011, The volkszaehler.org project
+ * @package vzlogger
+ * @license http://opensource.org/licenses/gpl-license.php GNU Public License
+ */
+/*
+ * This file is part of volkzaehler.org
+ *
+ * volkzaehler.org is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * volkzaehler.org is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "LineFormat.hpp"
+#include <VZException.hpp>
+
+LineFormat::LineFormat(const std::string &format) :
+		_format(format)
+		, _cache_next(0)
+{
+	bool value = false;
+
+	for (size_t i = 0; i < format.size(); i++) {
+		token_t token;
+		char c = format[i];
+
+		if (isspace(c)) {
+			token.type = token_space;
+			while (i + 1 < format.size() && isspace(format[i + 1])) i++;
+		}
+		else if (c == '$' && i + 1 < format.size() && strchr("vit", format[i + 1])) {
+			switch (format[++i]) {
+					case 'v': token.type = token_value; value = true; break;
+					case 'i': token.type = token_identifier; break;
+					case 't': token.type = token_timestamp; break;
+			}
+		}
+		else { /* merge text into one literal */
+			if (!_program.empty() && _program.back().type == token_literal) {
+				_program.back().literal += c;
+				continue;
+			}
+			token.type = token_literal;
+			token.literal = c;
+		}
+
+		_program.push_back(token);
+	}
+
+	if (!value) {
+		throw vz::VZException("Format has to contain $v.");
+	}
+}
+
+bool LineFormat::parse(const char *line, Reading &rd) {
+	const char *p = line;
+	char *end;
+
+	double value = 0, timestamp = 0;
+	bool has_value = false, has_timestamp = false;
+	const char *id = "";
+	size_t id_len = 0;
+
+	for (std::vector<token_t>::const_iterator it = _program.begin(); it != _program.end(); it++) {
+		switch (it->type) {
+				case token_space:
+					while (isspace(*p)) p++;
+					break;
+
+				case token_literal:
+					if (strncmp(p, it->literal.data(), it->literal.size()) != 0) goto done;
+					p += it->literal.size();
+					break;
+
+				case token_value:
+					value = strtod(p, &end);
+					if (end == p) goto done;
+					has_value = true;
+					p = end;
+					break;
+
+				case token_timestamp:
+					timestamp = strtod(p, &end);
+					if (end == p) goto done;
+					has_timestamp = true;
+					p = end;
+					break;
+
+				case token_identifier:
+					while (isspace(*p)) p++;
+					id = p;
+					while (*p != '\0' && !isspace(*p)) p++;
+					id_len = p - id;
+					if (id_len == 0) goto done;
+					break;
+		}
+	}
+
+	done: /* like scanf(), keep the fields converted so far */
+	if (!has_value) {
+		return false;
+	}
+
+	rd.value(value);
+	rd.identifier(_identifier(id, id_len));
+	if (has_timestamp) {
+		struct timeval tv = rd.dtotv(timestamp);
+		rd.time(tv);
+	}
+	else {
+		rd.time();
+	}
+
+	return true;
+}
+
+const StringIdentifier &LineFormat::_identifier(const char *name, size_t len) {
+	for (std::vector<cache_t>::iterator it = _cache.begin(); it != _cache.end(); it++) {
+		if (it->name.size() == len && memcmp(it->name.data(), name, len) == 0) {
+			return it->id;
+		}
+	}
+
+	/* miss, replace the oldest entry */
+	if (_cache.size() < LINEFORMAT_CACHE_SIZE) {
+		_cache.push_back(cache_t());
+		_cache_next = _cache.size() - 1;
+	}
+
+	cache_t &entry = _cache[_cache_next];
+	_cache_next = (_cache_next + 1) % LINEFORMAT_CACHE_SIZE;
+
+	entry.name.assign(name, len);
+	entry.id = StringIdentifier(entry.name);
+
+	return entry.id;
+}
+
+/*
+ * Local variables:
+ *  tab-width: 2
+ *  c-indent-level: 2
+ *  c-basic-offset: 2
+ *  project-name: vzlogger
+ * End:
+ */
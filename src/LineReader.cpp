@@ -0,0 +1,163 @@
+/**
+ * Buffered line reader for files, fifos and sockets
+ *
+ * @copyright Copyright (c) 2011, The volkszaehler.org project
+ * @package vzlogger
+ * @license http://opensource.org/licenses/gpl-license.php GNU Public License
+ */
+/*
+ * This file is part of volkzaehler.org
+ *
+ * volkzaehler.org is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * volkzaehler.org is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <algorithm>
+
+#include "LineReader.hpp"
+#include <common.h>
+
+LineReader::LineReader(size_t max_line) :
+		_buffer(LINEREADER_CHUNK_SIZE + 1)
+		, _begin(0)
+		, _scan(0)
+		, _end(0)
+		, _max_line(max_line)
+		, _discard(false)
+{
+}
+
+ssize_t LineReader::fill(int fd) {
+	ssize_t bytes;
+
+	_reserve();
+
+	do {
+		bytes = ::read(fd, &_buffer[_end], _buffer.size() - _end - 1);
+	} while (bytes < 0 && errno == EINTR);
+
+	if (bytes > 0) {
+		_end += bytes;
+	}
+
+	return bytes;
+}
+
+void LineReader::append(const char *data, size_t len) {
+	while (len > 0) {
+		_reserve();
+
+		size_t n = std::min(len, _buffer.size() - _end - 1);
+		memcpy(&_buffer[_end], data, n);
+		_end += n;
+		data += n;
+		len -= n;
+	}
+}
+
+char *LineReader::next(size_t *len) {
+	while (_scan < _end) {
+		char *start = &_buffer[_begin];
+		char *nl = (char *) memchr(&_buffer[_scan], '\n', _end - _scan);
+
+		if (nl == NULL) {
+			_scan = _end;
+			break;
+		}
+
+		size_t l = nl - start;
+		_begin += l + 1;
+		_scan = _begin;
+
+		if (_discard) { /* end of an overlong line */
+			_discard = false;
+			continue;
+		}
+
+		if (l > 0 && start[l - 1] == '\r') l--;
+		start[l] = '\0';
+
+		if (len) *len = l;
+		return start;
+	}
+
+	return NULL;
+}
+
+char *LineReader::rest(size_t *len) {
+	if (_begin == _end || _discard) {
+		clear();
+		return NULL;
+	}
+
+	char *start = &_buffer[_begin];
+	size_t l = _end - _begin;
+
+	if (l > 0 && start[l - 1] == '\r') l--;
+	start[l] = '\0'; /* there is always room for the terminator */
+
+	_begin = _scan = _end;
+
+	if (len) *len = l;
+	return start;
+}
+
+void LineReader::clear() {
+	_begin = _scan = _end = 0;
+	_discard = false;
+}
+
+void LineReader::_reserve() {
+	if (_begin == _end) { /* buffer is empty, start over */
+		_begin = _scan = _end = 0;
+	}
+
+	if (_buffer.size() - _end - 1 >= LINEREADER_CHUNK_SIZE) {
+		return;
+	}
+
+	if (_begin > 0) { /* move the incomplete line to the front */
+		memmove(&_buffer[0], &_buffer[_begin], _end - _begin);
+		_end -= _begin;
+		_scan -= _begin;
+		_begin = 0;
+	}
+
+	if (_buffer.size() - _end - 1 >= LINEREADER_CHUNK_SIZE) {
+		return;
+	}
+
+	if (_end + LINEREADER_CHUNK_SIZE <= _max_line ||
+			memchr(&_buffer[_scan], '\n', _end - _scan) != NULL) { /* grow for a long line or unread lines */
+		_buffer.resize(_end + LINEREADER_CHUNK_SIZE + 1);
+	}
+	else { /* line exceeds the limit */
+		if (!_discard) {
+			print(log_warning, "Discarding line longer than %lu bytes", NULL, _max_line);
+		}
+		_discard = true;
+		_begin = _scan = _end = 0;
+	}
+}
+
+/*
+ * Local variables:
+ *  tab-width: 2
+ *  c-indent-level: 2
+ *  c-basic-offset: 2
+ *  project-name: vzlogger
+ * End:
+ */
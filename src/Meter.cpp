@@ -48,10 +48,10 @@ static const meter_details_t protocols[] = {
 /*     aliasdescriptionmax_rdsperiodic
 			 ===============================================================================================*/
 	METER_DETAIL( file, File,"Read from file or fifo",32,true),
-//METER_DETAIL(exec, "Parse program output",32,true),
+	METER_DETAIL(exec, Exec, "Parse program output",32,true),
 	METER_DETAIL(random, Random, "Generate random values with a random walk",1,true),
 	METER_DETAIL(fluksov2, Fluksov2,"Read from Flukso's onboard SPI fifo",16,false),
-	METER_DETAIL(s0, S0,"S0-meter directly connected to RS232",3,true),
+	METER_DETAIL(s0, S0,"S0-meter directly connected to RS232 or gpios",32,true),
 	METER_DETAIL(d0, D0,"DLMS/IEC 62056-21 plaintext protocol",32,false),
 #ifdef SML_SUPPORT
 	METER_DETAIL(sml, Sml,"Smart Message Language as used by EDL-21, eHz and SyM²", 32,false),
@@ -115,31 +115,31 @@ Meter::Meter(std::list<Option> pOptions) :
 	switch(_protocol_id) {
 			case meter_protocol_file:
 				_protocol = vz::protocol::Protocol::Ptr(new MeterFile(pOptions));
-				_identifier = ReadingIdentifier::Ptr(new StringIdentifier());
+				_identifier = StringIdentifier();
 				break;
 			case meter_protocol_exec:
 				_protocol = vz::protocol::Protocol::Ptr(new MeterExec(pOptions));
-				_identifier = ReadingIdentifier::Ptr(new StringIdentifier());
+				_identifier = StringIdentifier();
 				break;
 			case meter_protocol_random:
 				_protocol = vz::protocol::Protocol::Ptr(new MeterRandom(pOptions));
-				_identifier = ReadingIdentifier::Ptr(new NilIdentifier());
+				_identifier = NilIdentifier();
 				break;
 			case meter_protocol_s0:
 				_protocol = vz::protocol::Protocol::Ptr(new MeterS0(pOptions));
-				_identifier = ReadingIdentifier::Ptr(new NilIdentifier());
+				_identifier = NilIdentifier();
 				break;
 			case meter_protocol_d0:
 				_protocol = vz::protocol::Protocol::Ptr(new MeterD0(pOptions));
-				_identifier = ReadingIdentifier::Ptr(new ObisIdentifier());
+				_identifier = ObisIdentifier();
 				break;
 			case  meter_protocol_sml:
 				_protocol = vz::protocol::Protocol::Ptr(new MeterSML(pOptions));
-				_identifier = ReadingIdentifier::Ptr(new ObisIdentifier());
+				_identifier = ObisIdentifier();
 				break;
 			case meter_protocol_fluksov2:
 				_protocol = vz::protocol::Protocol::Ptr(new MeterFluksoV2(pOptions));
-				_identifier = ReadingIdentifier::Ptr(new ChannelIdentifier());
+				_identifier = ChannelIdentifier();
 				break;
 			default:
 				break;
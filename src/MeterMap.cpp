@@ -34,11 +34,15 @@
  * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
  */
 #include <math.h>
+#include <algorithm>
 
 #include <MeterMap.hpp>
 #include <Config_Options.hpp>
 #include <api/Volkszaehler.hpp>
 #include <api/MySmartGrid.hpp>
+#include <api/Uploader.hpp>
+#include <MeterReactor.hpp>
+#include <MeterScheduler.hpp>
 
 extern Config_Options options;	/* global application options */
 
@@ -47,23 +51,44 @@ extern Config_Options options;	/* global application options */
 */
 void MeterMap::start() {
 	if(_meter->isEnabled()) {
+		index();
+
 		_meter->open();
 		print(log_info, "Meter connection established", _meter->name());
-		pthread_create(&_thread, NULL, &reading_thread, (void *) this);
-		print(log_debug, "Meter thread started", _meter->name());
+
+		if (_meter->protocol()->scheduled() && _meter->interval() <= 0) {
+			print(log_warning, "No interval given, reading every %i seconds", _meter->name(), SCHEDULER_DEFAULT_INTERVAL);
+			_meter->interval(SCHEDULER_DEFAULT_INTERVAL);
+		}
 
 		print(log_debug, "meter is opened. Start channels.", _meter->name());
 		for(iterator it = _channels.begin(); it!=_channels.end(); it++) {
 			/* set buffer length for perriodic meters */
 			if (meter_get_details(_meter->protocolId())->periodic && options.local()) {
-				(*it)->buffer()->keep(ceil(options.buffer_length() / (double) _meter->interval()));
+				(*it)->buffer()->keep((_meter->interval() > 0) ? ceil(options.buffer_length() / (double) _meter->interval()) : 0);
 			}
 
 			if (options.logging()) {
-				(*it)->start();
-				print(log_debug, "Logging thread started", (*it)->name());
+				if ((*it)->apiProtocol() == "mysmartgrid") {
+					(*it)->start();
+					print(log_debug, "Logging thread started", (*it)->name());
+				} else { /* volkszaehler channels share one uploader */
+					vz::api::Uploader::instance().add(*it);
+				}
 			}
 		}
+
+		/* channels (and their spools) are ready, start reading */
+		if (_meter->fd() >= 0 || _meter->deadline() > 0) { /* event or timer driven protocol, no thread of its own */
+			MeterReactor::instance().add(this);
+			_reactor = true;
+		} else if (_meter->protocol()->scheduled()) { /* polled by the shared scheduler */
+			MeterScheduler::instance().add(this);
+			_scheduled = true;
+		} else {
+			pthread_create(&_thread, NULL, &reading_thread, (void *) this);
+			print(log_debug, "Meter thread started", _meter->name());
+		}
 		_thread_running = true;
 	} else {
 		print(log_info, "Meter for protocol '%s' is disabled. Skipping.", _meter->name(),
@@ -71,9 +96,155 @@ void MeterMap::start() {
 	}
 
 }
+void MeterMap::index() {
+	_index.clear();
+	_wildcards.clear();
+	_masks.assign(1, 0); /* exact match */
+
+	for(iterator it = _channels.begin(); it!=_channels.end(); it++) {
+		const ReadingIdentifier &id = (*it)->identifier();
+
+		if (id.type() == ReadingIdentifier::type_nil) {
+			_wildcards.push_back(*it);
+			continue;
+		}
+
+		_index[id.key()].push_back(*it);
+		if (std::find(_masks.begin(), _masks.end(), id.mask()) == _masks.end()) {
+			_masks.push_back(id.mask());
+		}
+	}
+
+	print(log_debug, "Indexed channels (%lu identifiers, %lu wildcard masks, %lu nil)", _meter->name(),
+				_index.size(), _masks.size() - 1, _wildcards.size());
+}
+
+const MeterMap::channel_list &MeterMap::subscribers(uint64_t key) const {
+	static const channel_list none;
+
+	std::unordered_map<uint64_t, channel_list>::const_iterator it = _index.find(key);
+	return (it != _index.end()) ? it->second : none;
+}
+
+/**
+ * Append a reading to the queue of a subscribed channel
+ */
+static void queue_reading(const Channel::Ptr &ch, Reading &rd) {
+	if (ch->tvtod() < rd.tvtod()) {
+		ch->last(&rd);
+	}
+
+	print(log_info, "Adding reading to queue (value=%.2f ts=%.3f)", ch->name(),
+				rd.value(), rd.tvtod());
+	ch->push(rd);
+}
+
+void MeterMap::dispatch(std::vector<Reading> &rds, size_t n) {
+	/* dumping meter output */
+	if (options.verbosity() > log_debug) {
+		print(log_debug, "Got %i new readings from meter:", _meter->name(), n);
+
+		char identifier[MAX_IDENTIFIER_LEN];
+		for (size_t i = 0; i < n; i++) {
+			rds[i].unparse(identifier, MAX_IDENTIFIER_LEN);
+			print(log_debug, "Reading: id=%s/%s value=%.2f ts=%.3f", _meter->name(),
+						identifier, rds[i].identifier().toString().c_str(),
+						rds[i].value(), rds[i].tvtod());
+		}
+	}
+
+	/* insert readings into channel queues, readings without subscribers are dropped */
+	for (size_t i = 0; i < n; i++) {
+		const ReadingIdentifier &id = rds[i].identifier();
+
+		if (id.type() == ReadingIdentifier::type_nil) { /* meter without identifiers */
+			for(iterator ch = _channels.begin(); ch!=_channels.end(); ch++) {
+				queue_reading(*ch, rds[i]);
+			}
+			continue;
+		}
+
+		/* one lookup per wildcard mask, 0xff groups of the reading are concrete values */
+		uint64_t probed[64]; /* at most 2^6 masks */
+		size_t probes = 0;
+		size_t masks = (id.type() == ReadingIdentifier::type_obis) ? _masks.size() : 1;
+
+		for (size_t m = 0; m < masks; m++) {
+			uint64_t key = id.key() | _masks[m];
+
+			if (std::find(probed, probed + probes, key) != probed + probes) {
+				continue; /* reading has 0xff in these groups already */
+			}
+			probed[probes++] = key;
+
+			const channel_list &subscribed = subscribers(key);
+			for(const_iterator ch = subscribed.begin(); ch!=subscribed.end(); ch++) {
+				queue_reading(*ch, rds[i]);
+			}
+		}
+
+		for(const_iterator ch = _wildcards.begin(); ch!=_wildcards.end(); ch++) {
+			queue_reading(*ch, rds[i]);
+		}
+	}
+
+	for(iterator ch = _channels.begin(); ch!=_channels.end(); ch++) {
+		/* update buffer length */
+		if (options.local()) {
+			(*ch)->buffer()->keep((_meter->interval() > 0) ? ceil(options.buffer_length() / _meter->interval()) : 0);
+		}
+
+		/* shrink buffer, the logging thread acknowledges its readings itself */
+		if (!options.logging()) {
+			(*ch)->buffer()->shrink();
+		}
+
+		/* notify webserver and logging thread */
+		(*ch)->notify();
+
+		/* debugging */
+		if (options.verbosity() >= log_debug) {
+			size_t dump_len = 24;
+			char *dump = (char*)malloc(dump_len);
+
+			if (dump == NULL) {
+				print(log_error, "cannot allocate buffer", (*ch)->name());
+			}
+
+			while (dump == NULL || (*ch)->dump(dump, dump_len) == NULL) {
+				dump_len *= 1.5;
+				free(dump);
+				dump = (char*)malloc(dump_len);
+			}
+
+			print(log_debug, "Buffer dump (size=%i keep=%i): %s", (*ch)->name(),
+						(*ch)->size(), (*ch)->keep(), dump);
+
+			free(dump);
+		}
+	}
+
+	/* notify shared uploader */
+	if (options.logging()) {
+		vz::api::Uploader::instance().wakeup();
+	}
+}
+
 bool MeterMap::stopped() {
-	if(_meter->isEnabled()  && running() ) {
-		if( pthread_join(_thread, NULL) == 0 ) {
+	if(_meter->isEnabled()  && running() && (_reactor || _scheduled)) {
+		/* all event driven and all periodic meters share a thread */
+		if (_reactor ? MeterReactor::instance().join() : MeterScheduler::instance().join()) {
+			_thread_running = false;
+
+			for(iterator it = _channels.begin(); it!=_channels.end(); it++) {
+				(*it)->cancel();
+				(*it)->join();
+			}
+			return true;
+		}
+	}
+	else if(_meter->isEnabled()  && running() ) {
+		if( pthread_tryjoin_np(_thread, NULL) == 0 ) {
 			_thread_running = false;
 
 			// join channel-threads
@@ -93,14 +264,30 @@ void MeterMap::cancel() {
 			(*it)->cancel();
 			(*it)->join();
 		}
-		pthread_cancel(_thread);
-		pthread_join(_thread, NULL);
+		if (_reactor) {
+			MeterReactor::instance().cancel();
+		} else if (_scheduled) {
+			MeterScheduler::instance().cancel();
+		} else {
+			pthread_cancel(_thread);
+			pthread_join(_thread, NULL);
+		}
 		_thread_running = false;
 
 		//_channels.clear();
 	}
 }
 
+void MeterMap::flush() {
+	if (!_meter->isEnabled() || running()) {
+		return; /* channels are still fed by the meter */
+	}
+
+	for(iterator it = _channels.begin(); it!=_channels.end(); it++) {
+		(*it)->flush();
+	}
+}
+
 void MeterMap::registration() {
 	//Channel::Ptr ch;
 
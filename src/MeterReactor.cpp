@@ -0,0 +1,345 @@
+/**
+ * Event loop for meters with non-blocking file descriptors
+ *
+ * @copyright Copyright (c) 2011, The volkszaehler.org project
+ * @package vzlogger
+ * @license http://opensource.org/licenses/gpl-license.php GNU Public License
+ */
+/*
+ * This file is part of volkzaehler.org
+ *
+ * volkzaehler.org is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * volkzaehler.org is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <algorithm>
+
+#include <VZException.hpp>
+#include "Config_Options.hpp"
+#include <MeterReactor.hpp>
+#include <MeterMap.hpp>
+
+extern Config_Options options;
+
+MeterReactor &MeterReactor::instance() {
+	static MeterReactor reactor;
+	return reactor;
+}
+
+MeterReactor::MeterReactor()
+		: _thread_running(false)
+		, _thread_joined(false)
+{
+	_epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (_epfd < 0) {
+		throw vz::VZException("MeterReactor: cannot create epoll instance.");
+	}
+}
+
+MeterReactor::~MeterReactor() {
+	cancel();
+	close(_epfd);
+}
+
+void MeterReactor::add(MeterMap *mapping) {
+	Meter::Ptr mtr = mapping->meter();
+	source_t source;
+
+	if (running()) {
+		throw vz::VZException("MeterReactor: cannot add meters while running.");
+	}
+
+	source.mapping = mapping;
+	source.max_readings = meter_get_details(mtr->protocolId())->max_readings;
+	source.fd = -1;
+	source.last = time(NULL);
+	source.reopen_at = 0;
+	source.reopen_delay = 0;
+
+	/* allocate memory for readings */
+	for (size_t i = 0; i < source.max_readings; i++) {
+		source.rds.push_back(Reading(mtr->identifier()));
+	}
+
+	_sources.push_back(source);
+	if (mtr->fd() >= 0) { /* timer driven protocols may open their descriptor later */
+		watch(_sources.back());
+	}
+
+	print(log_debug, "Meter attached to reactor (fd=%d)", mtr->name(), mtr->fd());
+}
+
+void MeterReactor::watch(source_t &source) {
+	Meter::Ptr mtr = source.mapping->meter();
+	struct epoll_event ev;
+
+	source.fd = mtr->fd();
+	fcntl(source.fd, F_SETFL, fcntl(source.fd, F_GETFL) | O_NONBLOCK);
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = &source;
+
+	if (epoll_ctl(_epfd, EPOLL_CTL_ADD, source.fd, &ev) < 0) {
+		print(log_error, "Cannot watch meter: %s", mtr->name(), strerror(errno));
+		source.fd = -1;
+		throw vz::VZException("MeterReactor: cannot watch meter.");
+	}
+}
+
+void MeterReactor::unwatch(source_t &source) {
+	if (source.fd >= 0) {
+		epoll_ctl(_epfd, EPOLL_CTL_DEL, source.fd, NULL);
+		source.fd = -1;
+	}
+}
+
+void MeterReactor::start() {
+	if (running() || _sources.empty()) {
+		return;
+	}
+
+	pthread_create(&_thread, NULL, &thread, (void *) this);
+	_thread_running = true;
+	print(log_debug, "Reactor thread started for %lu meters", "reactor", _sources.size());
+}
+
+void MeterReactor::cancel() {
+	if (running()) {
+		pthread_cancel(_thread);
+		pthread_join(_thread, NULL);
+		_thread_running = false;
+		_thread_joined = true;
+	}
+}
+
+bool MeterReactor::join() {
+	if (_thread_joined) {
+		return true;
+	}
+
+	if (running() && pthread_tryjoin_np(_thread, NULL) == 0) {
+		_thread_running = false;
+		_thread_joined = true;
+		return true;
+	}
+
+	return false;
+}
+
+void * MeterReactor::thread(void *arg) {
+	MeterReactor *reactor = static_cast<MeterReactor *>(arg);
+
+	reactor->run();
+
+	pthread_exit(0);
+	return NULL;
+}
+
+void MeterReactor::run() {
+	struct epoll_event events[REACTOR_MAX_EVENTS];
+	size_t watched;
+
+	do { /* start thread mainloop */
+		int reopen_ms = reopen_due();
+		int timer_ms = timers_due();
+		int ready = epoll_wait(_epfd, events, REACTOR_MAX_EVENTS,
+													 (reopen_ms < 0 || (timer_ms >= 0 && timer_ms < reopen_ms)) ? timer_ms : reopen_ms);
+
+		if (ready < 0) {
+			if (errno == EINTR) continue;
+
+			print(log_error, "epoll_wait(): %s", "reactor", strerror(errno));
+			break;
+		}
+
+		for (int i = 0; i < ready; i++) {
+			source_t *source = static_cast<source_t *>(events[i].data.ptr);
+
+			if (source->fd >= 0 && !handle(*source)) {
+				reopen(*source);
+			}
+		}
+
+		watched = 0;
+		for (std::list<source_t>::iterator it = _sources.begin(); it != _sources.end(); it++) {
+			if (it->fd >= 0 || it->reopen_at > 0 || it->mapping->meter()->deadline() > 0) watched++;
+		}
+	} while (watched > 0 && (options.daemon() || options.local() || options.logging()));
+
+	print(log_debug, "Stop reading.! ", "reactor");
+}
+
+bool MeterReactor::handle(source_t &source) {
+	Meter::Ptr mtr = source.mapping->meter();
+	char buf[REACTOR_CHUNK_SIZE];
+
+	for (;;) {
+		ssize_t bytes = ::read(source.fd, buf, sizeof(buf));
+
+		if (bytes < 0) {
+			if (errno == EINTR) continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK) return true; /* drained */
+
+			print(log_error, "read(): %s", mtr->name(), strerror(errno));
+			return false;
+		}
+		else if (bytes == 0) {
+			ssize_t n = mtr->eof(source.rds, source.max_readings);
+			if (n < 0) {
+				print(log_warning, "Meter closed connection", mtr->name());
+				return false;
+			}
+
+			unwatch(source); /* released by the protocol, a new one is watched by timers_due() */
+			if (n > 0) {
+				deliver(source, n);
+			}
+			return true;
+		}
+
+		ssize_t n = mtr->feed(buf, bytes, source.rds, source.max_readings);
+		if (n < 0) {
+			print(log_error, "Failed to parse meter data", mtr->name());
+		}
+
+		/* hand readings over to the channels, then continue with buffered data */
+		for (; n > 0; n = mtr->feed(buf, 0, source.rds, source.max_readings)) {
+			deliver(source, n);
+		}
+
+		if ((size_t) bytes < sizeof(buf)) {
+			return true; /* level triggered, we will be woken again */
+		}
+	}
+}
+
+void MeterReactor::deliver(source_t &source, size_t n) {
+	Meter::Ptr mtr = source.mapping->meter();
+	time_t now = time(NULL);
+	time_t delta = now - source.last;
+	source.last = now;
+
+	/* update buffer length with current interval */
+	if (delta > 0 && delta != mtr->interval()) {
+		print(log_debug, "Updating interval to %i", mtr->name(), delta);
+		mtr->interval(delta);
+	}
+
+	source.mapping->dispatch(source.rds, n);
+	source.reopen_delay = 0;
+}
+
+void MeterReactor::reopen(source_t &source) {
+	Meter::Ptr mtr = source.mapping->meter();
+
+	if (source.fd >= 0) {
+		unwatch(source);
+		mtr->close();
+	}
+
+	source.reopen_delay = (source.reopen_delay > 0) ?
+		std::min(source.reopen_delay * 2, REACTOR_REOPEN_MAX_DELAY) : REACTOR_REOPEN_DELAY;
+	source.reopen_at = time(NULL) + source.reopen_delay;
+
+	print(log_info, "Reopening meter in %i secs", mtr->name(), source.reopen_delay);
+}
+
+int MeterReactor::reopen_due() {
+	time_t now = time(NULL);
+	int timeout = -1;
+
+	for (std::list<source_t>::iterator it = _sources.begin(); it != _sources.end(); it++) {
+		if (it->reopen_at == 0) {
+			continue;
+		}
+
+		if (it->reopen_at <= now) {
+			Meter::Ptr mtr = it->mapping->meter();
+
+			try {
+				mtr->open();
+				if (mtr->fd() >= 0) {
+					watch(*it);
+				}
+				it->reopen_at = 0;
+				print(log_info, "Meter connection reestablished", mtr->name());
+				continue;
+			}
+			catch (std::exception &e) {
+				print(log_error, "Cannot reopen meter: %s", mtr->name(), e.what());
+				reopen(*it); /* try again later */
+			}
+		}
+
+		int ms = (it->reopen_at - now) * 1000;
+		if (timeout < 0 || ms < timeout) {
+			timeout = ms;
+		}
+	}
+
+	return timeout;
+}
+
+int MeterReactor::timers_due() {
+	time_t now = time(NULL);
+	int timeout = -1;
+
+	for (std::list<source_t>::iterator it = _sources.begin(); it != _sources.end(); it++) {
+		Meter::Ptr mtr = it->mapping->meter();
+		time_t at = mtr->deadline();
+
+		if (at == 0 || it->reopen_at > 0) {
+			continue; /* no timer or meter closed */
+		}
+
+		if (at <= now) {
+			try {
+				mtr->timeout();
+				if (it->fd < 0 && mtr->fd() >= 0) {
+					watch(*it);
+				}
+			}
+			catch (std::exception &e) {
+				print(log_error, "Meter timer failed: %s", mtr->name(), e.what());
+				reopen(*it);
+				continue;
+			}
+
+			if ((at = mtr->deadline()) == 0) {
+				continue;
+			}
+		}
+
+		int ms = (at > now) ? (at - now) * 1000 : 0;
+		if (timeout < 0 || ms < timeout) {
+			timeout = ms;
+		}
+	}
+
+	return timeout;
+}
+
+/*
+ * Local variables:
+ *  tab-width: 2
+ *  c-indent-level: 2
+ *  c-basic-offset: 2
+ *  project-name: vzlogger
+ * End:
+ */
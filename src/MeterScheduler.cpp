@@ -0,0 +1,282 @@
+/**
+ * Timer wheel for periodic meters
+ *
+ * @copyright Copyright (c) 2011, The volkszaehler.org project
+ * @package vzlogger
+ * @license http://opensource.org/licenses/gpl-license.php GNU Public License
+ */
+/*
+ * This file is part of volkzaehler.org
+ *
+ * volkzaehler.org is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * volkzaehler.org is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+
+#include <VZException.hpp>
+#include "Config_Options.hpp"
+#include <MeterScheduler.hpp>
+#include <MeterMap.hpp>
+
+extern Config_Options options;
+
+MeterScheduler &MeterScheduler::instance() {
+	static MeterScheduler scheduler;
+	return scheduler;
+}
+
+MeterScheduler::MeterScheduler()
+		: _next(0)
+		, _thread_running(false)
+		, _thread_joined(false)
+{
+}
+
+MeterScheduler::~MeterScheduler() {
+	cancel();
+}
+
+void MeterScheduler::add(MeterMap *mapping) {
+	Meter::Ptr mtr = mapping->meter();
+	source_t source;
+
+	if (running()) {
+		throw vz::VZException("MeterScheduler: cannot add meters while running.");
+	}
+	if (mtr->interval() <= 0) {
+		throw vz::VZException("MeterScheduler: interval has to be positive.");
+	}
+
+	source.mapping = mapping;
+	source.max_readings = meter_get_details(mtr->protocolId())->max_readings;
+	source.interval = mtr->interval();
+	source.next = 0;
+	source.missed = 0;
+
+	/* allocate memory for readings */
+	for (size_t i = 0; i < source.max_readings; i++) {
+		source.rds.push_back(Reading(mtr->identifier()));
+	}
+
+	_sources.push_back(source);
+
+	print(log_debug, "Meter attached to scheduler (interval=%i)", mtr->name(), source.interval);
+}
+
+void MeterScheduler::start() {
+	if (running() || _sources.empty()) {
+		return;
+	}
+
+	/* first polls at the next multiple of each interval */
+	_next = time(NULL);
+	for (std::list<source_t>::iterator it = _sources.begin(); it != _sources.end(); it++) {
+		it->next = (_next / it->interval + 1) * it->interval;
+		insert(*it);
+	}
+
+	pthread_create(&_thread, NULL, &thread, (void *) this);
+	_thread_running = true;
+	print(log_debug, "Scheduler thread started for %lu meters", "scheduler", _sources.size());
+}
+
+void MeterScheduler::cancel() {
+	if (running()) {
+		pthread_cancel(_thread);
+		pthread_join(_thread, NULL);
+		_thread_running = false;
+		_thread_joined = true;
+	}
+}
+
+bool MeterScheduler::join() {
+	if (_thread_joined) {
+		return true;
+	}
+
+	if (running() && pthread_tryjoin_np(_thread, NULL) == 0) {
+		_thread_running = false;
+		_thread_joined = true;
+		return true;
+	}
+
+	return false;
+}
+
+void * MeterScheduler::thread(void *arg) {
+	MeterScheduler *scheduler = static_cast<MeterScheduler *>(arg);
+
+	scheduler->run();
+
+	pthread_exit(0);
+	return NULL;
+}
+
+void MeterScheduler::run() {
+	struct timespec wall, mono;
+
+	do { /* start thread mainloop */
+		clock_gettime(CLOCK_REALTIME, &wall);
+
+		if (wall.tv_sec < _next - 1 || wall.tv_sec - _next > SCHEDULER_MAX_CATCHUP) {
+			rebuild(wall.tv_sec);
+		}
+
+		while (_next <= wall.tv_sec) {
+			tick();
+		}
+
+		/* sleep on the monotonic clock, so a wall clock step back cannot stall the polls */
+		clock_gettime(CLOCK_REALTIME, &wall);
+		clock_gettime(CLOCK_MONOTONIC, &mono);
+
+		time_t at = wakeup();
+		if (at > wall.tv_sec) {
+			int64_t ns = (int64_t) (at - wall.tv_sec) * 1000000000LL - wall.tv_nsec;
+
+			mono.tv_sec += ns / 1000000000LL;
+			mono.tv_nsec += ns % 1000000000LL;
+			if (mono.tv_nsec >= 1000000000L) {
+				mono.tv_sec++;
+				mono.tv_nsec -= 1000000000L;
+			}
+
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &mono, NULL) == EINTR);
+		}
+	} while (options.daemon() || options.local() || options.logging());
+
+	print(log_debug, "Stop reading.! ", "scheduler");
+}
+
+void MeterScheduler::insert(source_t &source) {
+	time_t expires = source.next;
+	time_t delta = expires - _next;
+	int level = 0;
+
+	if (delta < 0) { /* overdue, poll with the next tick */
+		_wheel[0][_next & SCHEDULER_WHEEL_MASK].push_back(&source);
+		return;
+	}
+
+	if (delta >= (time_t) 1 << (SCHEDULER_WHEEL_BITS * SCHEDULER_LEVELS)) {
+		expires = _next + ((time_t) 1 << (SCHEDULER_WHEEL_BITS * SCHEDULER_LEVELS)) - 1; /* reinserted by cascade() */
+	}
+
+	while (level < SCHEDULER_LEVELS - 1 && delta >= (time_t) 1 << (SCHEDULER_WHEEL_BITS * (level + 1))) {
+		level++;
+	}
+
+	_wheel[level][(expires >> (SCHEDULER_WHEEL_BITS * level)) & SCHEDULER_WHEEL_MASK].push_back(&source);
+}
+
+void MeterScheduler::tick() {
+	int index = _next & SCHEDULER_WHEEL_MASK;
+	slot_t due;
+
+	if (index == 0) { /* level 0 wrapped around, refill it from the upper levels */
+		for (int level = 1; level < SCHEDULER_LEVELS && cascade(level) == 0; level++);
+	}
+
+	due.swap(_wheel[0][index]);
+	_next++;
+
+	for (slot_t::iterator it = due.begin(); it != due.end(); it++) {
+		poll(**it);
+		reschedule(**it, time(NULL));
+	}
+}
+
+int MeterScheduler::cascade(int level) {
+	int index = (_next >> (SCHEDULER_WHEEL_BITS * level)) & SCHEDULER_WHEEL_MASK;
+	slot_t entries;
+
+	entries.swap(_wheel[level][index]);
+	for (slot_t::iterator it = entries.begin(); it != entries.end(); it++) {
+		insert(**it);
+	}
+
+	return index;
+}
+
+void MeterScheduler::rebuild(time_t now) {
+	bool back = now < _next - 1;
+
+	print(log_warning, "Wall clock jumped by %li secs, rescheduling meters", "scheduler", (long) (now - _next));
+
+	for (int level = 0; level < SCHEDULER_LEVELS; level++) {
+		for (int index = 0; index < SCHEDULER_WHEEL_SIZE; index++) {
+			_wheel[level][index].clear();
+		}
+	}
+
+	_next = now;
+	for (std::list<source_t>::iterator it = _sources.begin(); it != _sources.end(); it++) {
+		if (back) { /* realign, overdue polls of a forward jump are counted as missed */
+			it->next = (now / it->interval + 1) * it->interval;
+		}
+		insert(*it);
+	}
+}
+
+time_t MeterScheduler::wakeup() const {
+	time_t at = _next;
+
+	while ((at & SCHEDULER_WHEEL_MASK) != 0 && _wheel[0][at & SCHEDULER_WHEEL_MASK].empty()) {
+		at++;
+	}
+
+	return at;
+}
+
+void MeterScheduler::poll(source_t &source) {
+	Meter::Ptr mtr = source.mapping->meter();
+
+	try {
+		ssize_t n = mtr->read(source.rds, source.max_readings);
+
+		if (n > 0) {
+			source.mapping->dispatch(source.rds, n);
+		}
+	}
+	catch (std::exception &e) {
+		print(log_error, "Failed to read meter: %s", mtr->name(), e.what());
+	}
+}
+
+void MeterScheduler::reschedule(source_t &source, time_t now) {
+	time_t next = (now / source.interval + 1) * source.interval;
+
+	if (next - source.next > source.interval) {
+		unsigned long missed = (next - source.next) / source.interval - 1;
+		source.missed += missed;
+
+		print(log_warning, "Missed %lu readings (%lu in total), meter was not read in time", source.mapping->meter()->name(),
+					missed, source.missed);
+	}
+
+	source.next = next;
+	insert(source);
+
+	print(log_debug, "Next reading in %li seconds", source.mapping->meter()->name(), (long) (next - now));
+}
+
+/*
+ * Local variables:
+ *  tab-width: 2
+ *  c-indent-level: 2
+ *  c-basic-offset: 2
+ *  project-name: vzlogger
+ * End:
+ */
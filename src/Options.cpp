@@ -121,7 +121,7 @@ Option::operator bool() const {
 }
 
 //Option& OptionList::lookup(List<Option> options, char *key) {
-const Option &OptionList::lookup(std::list<Option> options, const std::string &key) {
+const Option &OptionList::lookup(const std::list<Option> &options, const std::string &key) {
 	for(const_iterator it = options.begin(); it != options.end(); it++) {
 		if ( it->key() == key ) {
 			return (*it);
@@ -131,27 +131,27 @@ const Option &OptionList::lookup(std::list<Option> options, const std::string &k
 	throw vz::OptionNotFoundException("Option '"+ std::string(key) +"' not found");
 }
 
-const char *OptionList::lookup_string(std::list<Option> options, const char *key)
+const char *OptionList::lookup_string(const std::list<Option> &options, const char *key)
 {
-	Option opt = lookup(options, key);
+	const Option &opt = lookup(options, key);
 	return (const char*)opt;
 }
 
-const int OptionList::lookup_int(std::list<Option> options, const char *key)
+const int OptionList::lookup_int(const std::list<Option> &options, const char *key)
 {
-	Option opt = lookup(options, key);
+	const Option &opt = lookup(options, key);
 	return (int)opt;
 }
 
-const bool OptionList::lookup_bool(std::list<Option> options, const char *key)
+const bool OptionList::lookup_bool(const std::list<Option> &options, const char *key)
 {
-	Option opt = lookup(options, key);
+	const Option &opt = lookup(options, key);
 	return (bool)opt;
 }
 
-const double OptionList::lookup_double(std::list<Option> options, const char *key)
+const double OptionList::lookup_double(const std::list<Option> &options, const char *key)
 {
-	Option opt = lookup(options, key);
+	const Option &opt = lookup(options, key);
 	return (double)opt;
 }
 
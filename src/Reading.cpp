@@ -24,7 +24,10 @@
  */
 
 #include <iostream>
+#include <map>
+#include <deque>
 
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -33,15 +36,26 @@
 #include "VZException.hpp"
 #include "Reading.hpp"
 
+const double Reading::_pow10[READING_POW10_MAX + 1] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
 Reading::Reading()
-		: _deleted(false)
-		, _value(0)
+		: _value(0)
+		, _mantissa(0)
+		, _exponent(0)
+		, _exact(false)
+		, _unit(0)
 {
 }
 
-Reading::Reading(ReadingIdentifier::Ptr pIndentifier)
-		: _deleted(false)
-		, _value(0)
+Reading::Reading(const ReadingIdentifier &pIndentifier)
+		: _value(0)
+		, _mantissa(0)
+		, _exponent(0)
+		, _exact(false)
+		, _unit(0)
 								//    , time(0)
 		, _identifier(pIndentifier)
 {
@@ -50,10 +64,13 @@ Reading::Reading(ReadingIdentifier::Ptr pIndentifier)
 Reading::Reading(
 	double pValue
 	, struct timeval pTime
-	, ReadingIdentifier::Ptr pIndentifier
+	, const ReadingIdentifier &pIndentifier
 	)
-		: _deleted(false)
-		, _value(pValue)
+		: _value(pValue)
+		, _mantissa(0)
+		, _exponent(0)
+		, _exact(false)
+		, _unit(0)
 		, _time(pTime)
 		, _identifier(pIndentifier)
 {
@@ -62,14 +79,30 @@ Reading::Reading(
 Reading::Reading(
 	const Reading &orig
 	) :
-		_deleted(orig._deleted)
-		, _value(orig._value)
+		_value(orig._value)
+		, _mantissa(orig._mantissa)
+		, _exponent(orig._exponent)
+		, _exact(orig._exact)
+		, _unit(orig._unit)
 		, _time(orig._time)
 		, _identifier (orig._identifier)
 {
 //	printf("+==>Copy: %f %f orig %f %f\n", tvtod(), _value, orig.tvtod(), orig._value);
 }
 
+Reading &Reading::operator=(
+	const Reading &orig
+	) {
+	_value = orig._value;
+	_mantissa = orig._mantissa;
+	_exponent = orig._exponent;
+	_exact = orig._exact;
+	_unit = orig._unit;
+	_time = orig._time;
+	_identifier = orig._identifier;
+	return *this;
+}
+
 const double Reading::tvtod() const {
 	return _time.tv_sec + _time.tv_usec / 1e6;
 }
@@ -89,13 +122,13 @@ struct timeval Reading::dtotv(double ts) {
 	return tv;
 }
 
-ReadingIdentifier::Ptr reading_id_parse(meter_protocol_t protocol, const char *string) {
-	ReadingIdentifier::Ptr rid;
+ReadingIdentifier reading_id_parse(meter_protocol_t protocol, const char *string) {
+	ReadingIdentifier rid;
 
 	switch (protocol) {
 			case meter_protocol_d0:
 			case meter_protocol_sml:
-				rid = ReadingIdentifier::Ptr(new ObisIdentifier(Obis(string)));
+				rid = ObisIdentifier(Obis(string));
 				break;
 
 			case meter_protocol_fluksov2: {
@@ -106,7 +139,7 @@ ReadingIdentifier::Ptr reading_id_parse(meter_protocol_t protocol, const char *s
 				if (ret != 2) {
 					throw vz::VZException("meter-fluksov4 failed");
 				}
-				rid = ReadingIdentifier::Ptr(new ChannelIdentifier(channel+1));
+				rid = ChannelIdentifier(channel+1);
 
 				//id->channel = channel + 1; /* increment by 1 to distinguish between +0 and -0 */
 
@@ -124,11 +157,23 @@ ReadingIdentifier::Ptr reading_id_parse(meter_protocol_t protocol, const char *s
 
 			case meter_protocol_file:
 			case meter_protocol_exec:
-				rid = ReadingIdentifier::Ptr(new StringIdentifier(string));
+				rid = StringIdentifier(string);
+				break;
+
+			case meter_protocol_s0: /* "power" and "counter" are shortcuts for the first input */
+				if (strcmp(string, "power") == 0) {
+					rid = ChannelIdentifier(1);
+				}
+				else if (strcmp(string, "counter") == 0) {
+					rid = ChannelIdentifier(-1);
+				}
+				else {
+					rid = ChannelIdentifier::parse(string);
+				}
 				break;
 
 			default: /* ignore other protocols which do not provide id's */
-				rid = ReadingIdentifier::Ptr(new NilIdentifier());
+				rid = NilIdentifier();
 				break;
 	}
 
@@ -141,7 +186,7 @@ size_t Reading::unparse(
 	char *buffer, size_t n
 	) {
 
-	return _identifier->unparse(buffer, n);
+	return _identifier.unparse(buffer, n);
 
 #if 0
 	switch (protocol) {
@@ -169,61 +214,107 @@ size_t Reading::unparse(
 #endif
 }
 
-bool ReadingIdentifier::operator==( ReadingIdentifier &cmp) {
-	return this->compare(this, &cmp);
-}
-
-bool ReadingIdentifier::compare( ReadingIdentifier *lhs,  ReadingIdentifier *rhs) {
-	if(ObisIdentifier* lhsx = dynamic_cast<ObisIdentifier*>(lhs)) {
-		if(ObisIdentifier* rhsx = dynamic_cast<ObisIdentifier*>(rhs)) {
-			return *lhsx == *rhsx;
-		} else { return -1; }
-	} else 
-		if( StringIdentifier* lhsx = dynamic_cast<StringIdentifier*>(rhs)) {
-			if(StringIdentifier* rhsx = dynamic_cast<StringIdentifier*>(lhs)) {
-				return lhsx == rhsx;
-			} else { return -1; }
-		} else 
-			if(ChannelIdentifier* lhsx = dynamic_cast<ChannelIdentifier*>(lhs)) {
-				if(ChannelIdentifier* rhsx = dynamic_cast<ChannelIdentifier*>(rhs)) {
-					return lhsx == rhsx;
-				} else { return -1; }
-			}
-	return -1;
+bool ReadingIdentifier::compare(const ReadingIdentifier &cmp) const {
+	if (type() == type_nil || cmp.type() == type_nil) {
+		return true; /* nil identifiers match everything */
+	}
+
+	if (type() != type_obis || cmp.type() != type_obis) {
+		return false; /* different types or values */
+	}
+
+	/* ignore groups which are a wildcard on either side */
+	return ((_key ^ cmp._key) & ~(mask() | cmp.mask())) == 0;
 }
 
-size_t ObisIdentifier::unparse(char *buffer, size_t n) {
-	return _obis.unparse(buffer, n);
+size_t ReadingIdentifier::unparse(char *buffer, size_t n) const {
+	switch (type()) {
+			case type_obis:
+				return ObisIdentifier::decode(value()).unparse(buffer, n);
+
+			case type_channel: {
+				int channel = (int32_t) (uint32_t) value(); /* see ChannelIdentifier::channel() */
+				return snprintf(buffer, n, "sensor%u/%s", abs(channel) - 1, (channel > 0) ? "power" : "consumption");
+			}
+
+			case type_string:
+				strncpy(buffer, StringIdentifier::lookup(value()).c_str(), n);
+				return strlen(buffer);
+
+			default:
+				return snprintf(buffer, n, "NilItentifier");
+	}
 }
-bool ObisIdentifier::operator==(ObisIdentifier &cmp) {
-	return (_obis == cmp.obis());
+
+const std::string ReadingIdentifier::toString() const {
+	std::ostringstream oss;
+
+	switch (type()) {
+			case type_obis:
+				oss << "ObisItentifier:" << ObisIdentifier::decode(value()).toString();
+				break;
+			case type_channel:
+				oss << "ChannelItentifier:";
+				break;
+			case type_string:
+				oss << "StringItentifier:";
+				break;
+			default:
+				oss << "NilItentifier";
+				break;
+	}
+
+	return oss.str();
 }
 
-/* StringIdentifier */
-bool StringIdentifier::operator==(StringIdentifier &cmp) {
-	return (_string == cmp._string);
+/* ObisIdentifier */
+uint64_t ObisIdentifier::encode(const unsigned char *raw) {
+	uint64_t value = 0;
+
+	for (int i = 0; i < 6; i++) {
+		value = (value << 8) | raw[i];
+	}
+
+	return value;
 }
 
-void StringIdentifier::parse(const char *string) {
-	_string = string;
+Obis ObisIdentifier::decode(uint64_t value) {
+	return Obis(value >> 40, value >> 32, value >> 24, value >> 16, value >> 8, value);
 }
 
-size_t StringIdentifier::unparse(char *buffer, size_t n) {
-	if (_string != "") {
-		strncpy(buffer, _string.c_str(), n);
-	} else {
-		strncpy(buffer, "", n);
+/* StringIdentifier */
+static pthread_mutex_t string_table_mutex = PTHREAD_MUTEX_INITIALIZER;
+static std::map<std::string, uint32_t> string_table;
+static std::deque<std::string> string_table_ids;
+
+uint32_t StringIdentifier::intern(const std::string &s) {
+	pthread_mutex_lock(&string_table_mutex);
+
+	std::map<std::string, uint32_t>::iterator it = string_table.find(s);
+	uint32_t id;
+	if (it != string_table.end()) {
+		id = it->second;
+	}
+	else {
+		id = string_table_ids.size();
+		string_table_ids.push_back(s);
+		string_table[s] = id;
 	}
 
-	return strlen(buffer);
+	pthread_mutex_unlock(&string_table_mutex);
+	return id;
 }
 
-/* ChannelIdentifier */
-bool ChannelIdentifier::operator==(ChannelIdentifier &cmp) {
-	return (_channel == cmp._channel);
+const std::string StringIdentifier::lookup(uint32_t id) {
+	pthread_mutex_lock(&string_table_mutex);
+	std::string s = (id < string_table_ids.size()) ? string_table_ids[id] : "";
+	pthread_mutex_unlock(&string_table_mutex);
+
+	return s;
 }
 
-void ChannelIdentifier::parse(const char *string) {
+/* ChannelIdentifier */
+ChannelIdentifier ChannelIdentifier::parse(const char *string) {
 	char type[13];
 	int channel;
 	int ret = sscanf(string, "sensor%u/%12s", &channel, type);
@@ -232,22 +323,14 @@ void ChannelIdentifier::parse(const char *string) {
 		throw vz::VZException("Failed to parse channel identifier");
 	}
 
-	_channel = channel + 1; /* increment by 1 to distinguish between +0 and -0 */
+	channel++; /* increment by 1 to distinguish between +0 and -0 */
 
 	if (strcmp(type, "consumption") == 0) {
-		_channel *= -1;
+		channel *= -1;
 	}
 	else if (strcmp(type, "power") != 0) {
 		throw vz::VZException("Invalid channel type");
 	}
-}
-
-size_t ChannelIdentifier::unparse(char *buffer, size_t n) {
-	return snprintf(buffer, n, "sensor%u/%s", abs(_channel) - 1, (_channel > 0) ? "power" : "consumption");
-}
 
-size_t NilIdentifier::unparse(char *buffer, size_t n) {
-	return snprintf(buffer, n, "NilItentifier");
-//buffer[0] = '\0';
-	//return strlen(buffer);
+	return ChannelIdentifier(channel);
 }
@@ -0,0 +1,302 @@
+/**
+ * Persistent spool for readings (append-only segment log)
+ *
+ * Each segment is a preallocated file of SPOOL_SEGMENT_RECORDS fixed size
+ * records which is mapped into memory. A record is valid as soon as its
+ * magic has been written, so the write position can be recovered after a
+ * crash. The acknowledged position is kept in a separate small state file.
+ *
+ * @copyright Copyright (c) 2011, The volkszaehler.org project
+ * @package vzlogger
+ * @license http://opensource.org/licenses/gpl-license.php GNU Public License
+ */
+/*
+ * This file is part of volkzaehler.org
+ *
+ * volkzaehler.org is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * volkzaehler.org is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <vector>
+
+#include "Spool.hpp"
+#include <VZException.hpp>
+#include <common.h>
+
+#define SPOOL_SEGMENT_SIZE (SPOOL_SEGMENT_RECORDS * sizeof(record_t))
+
+Spool::Spool(const std::string &path, size_t max_size, sync_t sync, int interval) :
+		_path(path)
+		, _sync_policy(sync)
+		, _sync_interval(interval)
+		, _last_sync(time(NULL))
+		, _write(0)
+		, _read(0)
+		, _ack(0)
+{
+	std::vector<uint64_t> numbers;
+
+	pthread_mutex_init(&_mutex, NULL);
+
+	/* we need at least one segment to write and one to read from */
+	_max_segments = std::max(max_size / SPOOL_SEGMENT_SIZE, (size_t) 2);
+
+	if (mkdir(_path.c_str(), 0755) < 0 && errno != EEXIST) {
+		print(log_error, "Cannot create spool %s: %s", NULL, _path.c_str(), strerror(errno));
+		pthread_mutex_destroy(&_mutex);
+		throw vz::VZException("Cannot create spool.");
+	}
+
+	/* open state */
+	std::string state = _path + "/ack";
+	_state_fd = open(state.c_str(), O_RDWR | O_CREAT, 0644);
+	if (_state_fd < 0 || ftruncate(_state_fd, sizeof(uint64_t)) < 0) {
+		print(log_error, "Cannot open spool state %s: %s", NULL, state.c_str(), strerror(errno));
+		if (_state_fd >= 0) close(_state_fd);
+		pthread_mutex_destroy(&_mutex);
+		throw vz::VZException("Cannot open spool state.");
+	}
+
+	_state = (uint64_t *) mmap(NULL, sizeof(uint64_t), PROT_READ | PROT_WRITE, MAP_SHARED, _state_fd, 0);
+	if (_state == MAP_FAILED) {
+		close(_state_fd);
+		pthread_mutex_destroy(&_mutex);
+		throw vz::VZException("Cannot map spool state.");
+	}
+
+	/* find existing segments */
+	DIR *dir = opendir(_path.c_str());
+	struct dirent *entry;
+	while (dir && (entry = readdir(dir)) != NULL) {
+		unsigned long long number;
+		char suffix[4];
+
+		if (sscanf(entry->d_name, "%16llx.%3s", &number, suffix) == 2 && strcmp(suffix, "seg") == 0) {
+			numbers.push_back(number);
+		}
+	}
+	if (dir) closedir(dir);
+	std::sort(numbers.begin(), numbers.end());
+
+	/* only consecutive segments following the last gap are usable */
+	for (size_t i = 0; i < numbers.size(); i++) {
+		if (!_segments.empty() && numbers[i] != _segments.back().number + 1) {
+			print(log_warning, "Discarding spool segments before gap", NULL);
+			while (!_segments.empty()) _drop_segment();
+		}
+		_open_segment(numbers[i], false);
+	}
+
+	_ack = *_state;
+
+	if (_segments.empty()) {
+		_write = _ack;
+	}
+	else {
+		/* recover write position: first incomplete record of the last segment */
+		segment_t &last = _segments.back();
+		size_t i;
+		for (i = 0; i < SPOOL_SEGMENT_RECORDS && last.records[i].magic == SPOOL_MAGIC; i++);
+		_write = last.number * SPOOL_SEGMENT_RECORDS + i;
+
+		uint64_t first = _segments.front().number * SPOOL_SEGMENT_RECORDS;
+		if (_ack < first || _ack > _write) { /* segments have been dropped */
+			_ack = first;
+		}
+	}
+	_read = _ack;
+
+	if (size() > 0) {
+		print(log_info, "Recovered %llu unacknowledged readings from spool %s", NULL,
+					(unsigned long long) size(), _path.c_str());
+	}
+}
+
+Spool::~Spool() {
+	while (!_segments.empty()) {
+		segment_t &seg = _segments.front();
+		_sync(seg.fd, seg.records, SPOOL_SEGMENT_SIZE, _sync_policy != sync_never);
+		munmap(seg.records, SPOOL_SEGMENT_SIZE);
+		close(seg.fd);
+		_segments.pop_front();
+	}
+
+	munmap(_state, sizeof(uint64_t));
+	close(_state_fd);
+
+	pthread_mutex_destroy(&_mutex);
+}
+
+void Spool::append(const Reading &rd) {
+	pthread_mutex_lock(&_mutex);
+
+	if (_segments.empty() || _write % SPOOL_SEGMENT_RECORDS == 0) {
+		uint64_t number = _write / SPOOL_SEGMENT_RECORDS;
+
+		if (_segments.empty() || _segments.back().number != number) {
+			if (!_segments.empty()) { /* flush the finished segment */
+				segment_t &prev = _segments.back();
+				_sync(prev.fd, prev.records, SPOOL_SEGMENT_SIZE, _sync_policy != sync_never);
+			}
+
+			while (_segments.size() >= _max_segments) {
+				_drop_segment(); /* enforce size cap */
+			}
+
+			try {
+				_open_segment(number, true);
+			} catch (vz::VZException &e) {
+				pthread_mutex_unlock(&_mutex);
+				throw;
+			}
+		}
+	}
+
+	segment_t &seg = _segments.back();
+	record_t *rec = _record(_write);
+	rec->sec = rd.tv().tv_sec;
+	rec->usec = rd.tv().tv_usec;
+	rec->value = rd.value();
+	__sync_synchronize(); /* record has to be complete before it is marked valid */
+	rec->magic = SPOOL_MAGIC;
+
+	_write++;
+	_sync(seg.fd, seg.records, SPOOL_SEGMENT_SIZE, false);
+
+	pthread_mutex_unlock(&_mutex);
+}
+
+size_t Spool::read(Reading *rds, size_t max, const ReadingIdentifier &id) {
+	size_t n = 0;
+
+	pthread_mutex_lock(&_mutex);
+
+	for (; _read < _write && n < max; _read++, n++) {
+		record_t *rec = _record(_read);
+		struct timeval tv;
+
+		tv.tv_sec = rec->sec;
+		tv.tv_usec = rec->usec;
+		rds[n].value(rec->value);
+		rds[n].time(tv);
+		rds[n].identifier(id);
+	}
+
+	pthread_mutex_unlock(&_mutex);
+
+	return n;
+}
+
+void Spool::ack() {
+	pthread_mutex_lock(&_mutex);
+
+	_ack = _read;
+	*_state = _ack;
+	_sync(_state_fd, _state, sizeof(uint64_t), false);
+
+	/* remove segments which have been acknowledged completely */
+	while (!_segments.empty() && (_segments.front().number + 1) * SPOOL_SEGMENT_RECORDS <= _ack) {
+		_drop_segment();
+	}
+
+	pthread_mutex_unlock(&_mutex);
+}
+
+void Spool::_open_segment(uint64_t number, bool create) {
+	segment_t seg;
+	std::string path = _segment_path(number);
+
+	seg.number = number;
+	seg.fd = open(path.c_str(), O_RDWR | (create ? O_CREAT | O_TRUNC : 0), 0644);
+	if (seg.fd < 0 || ftruncate(seg.fd, SPOOL_SEGMENT_SIZE) < 0) {
+		print(log_error, "Cannot open spool segment %s: %s", NULL, path.c_str(), strerror(errno));
+		if (seg.fd >= 0) close(seg.fd);
+		throw vz::VZException("Cannot open spool segment.");
+	}
+
+	seg.records = (record_t *) mmap(NULL, SPOOL_SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, seg.fd, 0);
+	if (seg.records == MAP_FAILED) {
+		close(seg.fd);
+		throw vz::VZException("Cannot map spool segment.");
+	}
+
+	_segments.push_back(seg);
+}
+
+void Spool::_drop_segment() {
+	segment_t &seg = _segments.front();
+	uint64_t end = (seg.number + 1) * SPOOL_SEGMENT_RECORDS;
+
+	if (_ack < end) { /* spool is full, lose the oldest readings */
+		if (_write > _ack) {
+			print(log_warning, "Spool %s full, dropping %llu unacknowledged readings", NULL,
+						_path.c_str(), (unsigned long long) (std::min(end, _write) - _ack));
+		}
+		_ack = end;
+		*_state = _ack;
+	}
+	if (_read < _ack) _read = _ack;
+	if (_write < _ack) _write = _ack;
+
+	munmap(seg.records, SPOOL_SEGMENT_SIZE);
+	close(seg.fd);
+	unlink(_segment_path(seg.number).c_str());
+
+	_segments.pop_front();
+}
+
+void Spool::_sync(int fd, void *addr, size_t len, bool force) {
+	time_t now;
+
+	switch (_sync_policy) {
+			case sync_always:
+				break;
+
+			case sync_interval:
+				now = time(NULL);
+				if (!force && now - _last_sync < _sync_interval) return;
+				_last_sync = now;
+				break;
+
+			default:
+				if (!force) return;
+	}
+
+	msync(addr, len, MS_SYNC);
+}
+
+std::string Spool::_segment_path(uint64_t number) const {
+	char name[32];
+
+	snprintf(name, sizeof(name), "/%016llx.seg", (unsigned long long) number);
+	return _path + name;
+}
+
+/*
+ * Local variables:
+ *  tab-width: 2
+ *  c-indent-level: 2
+ *  c-basic-offset: 2
+ *  project-name: vzlogger
+ * End:
+ */
@@ -0,0 +1,175 @@
+/**
+ * Retry scheduling for failed requests
+ *
+ * @copyright Copyright (c) 2011, The volkszaehler.org project
+ * @package vzlogger
+ * @license http://opensource.org/licenses/gpl-license.php GNU Public License
+ */
+/*
+ * This file is part of volkzaehler.org
+ *
+ * volkzaehler.org is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * volkzaehler.org is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include "Config_Options.hpp"
+#include <api/Backoff.hpp>
+#include <common.h>
+
+extern Config_Options options;
+
+std::map<std::string, vz::api::Circuit::Ptr> vz::api::Circuit::_hosts;
+pthread_mutex_t vz::api::Circuit::_hosts_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+vz::api::Backoff::Backoff(int base, int cap)
+		: _base(base)
+		, _cap(std::max(base, cap))
+		, _failures(0)
+		, _retry_at(0)
+{
+	_seed = time(NULL) ^ getpid() ^ (unsigned long) this;
+}
+
+void vz::api::Backoff::failure(time_t now) {
+	int delay = _base << std::min(_failures, (unsigned) BACKOFF_MAX_SHIFT);
+
+	if (delay > _cap || delay < _base) {
+		delay = _cap;
+	}
+
+	/* keep the lower half, randomize the upper half */
+	delay = delay / 2 + rand_r(&_seed) % (delay - delay / 2 + 1);
+
+	_failures++;
+	_retry_at = now + delay;
+}
+
+void vz::api::Backoff::success() {
+	_failures = 0;
+	_retry_at = 0;
+}
+
+vz::api::Circuit::Ptr vz::api::Circuit::host(const std::string &url) {
+	std::string host = url;
+	Ptr circuit;
+
+	/* scheme://host:port/path => scheme://host:port */
+	size_t start = url.find("://");
+	size_t end = url.find('/', (start == std::string::npos) ? 0 : start + 3);
+	if (end != std::string::npos) {
+		host = url.substr(0, end);
+	}
+
+	pthread_mutex_lock(&_hosts_mutex);
+	std::map<std::string, Ptr>::iterator it = _hosts.find(host);
+	if (it == _hosts.end()) {
+		circuit = Ptr(new Circuit(host, options.breaker(), options.retry_pause(), options.retry_max()));
+		_hosts[host] = circuit;
+	} else {
+		circuit = it->second;
+	}
+	pthread_mutex_unlock(&_hosts_mutex);
+
+	return circuit;
+}
+
+vz::api::Circuit::Circuit(const std::string &host, unsigned threshold, int base, int cap)
+		: _host(host)
+		, _threshold(threshold)
+		, _failures(0)
+		, _state(circuit_closed)
+		, _probing(false)
+		, _backoff(base, cap)
+{
+	pthread_mutex_init(&_mutex, NULL);
+}
+
+vz::api::Circuit::~Circuit() {
+	pthread_mutex_destroy(&_mutex);
+}
+
+bool vz::api::Circuit::allow(time_t now) {
+	bool allow = true;
+
+	pthread_mutex_lock(&_mutex);
+	if (_state == circuit_open && now >= _backoff.retry_at()) {
+		print(log_info, "Probing middleware %s", "push", _host.c_str());
+		_state = circuit_half_open;
+	}
+
+	if (_state == circuit_open || (_state == circuit_half_open && _probing)) {
+		allow = false;
+	}
+	pthread_mutex_unlock(&_mutex);
+
+	return allow;
+}
+
+void vz::api::Circuit::attempt() {
+	pthread_mutex_lock(&_mutex);
+	if (_state == circuit_half_open) {
+		_probing = true;
+	}
+	pthread_mutex_unlock(&_mutex);
+}
+
+void vz::api::Circuit::success() {
+	pthread_mutex_lock(&_mutex);
+	if (_state != circuit_closed) {
+		print(log_info, "Middleware %s is available again", "push", _host.c_str());
+	}
+	_state = circuit_closed;
+	_failures = 0;
+	_probing = false;
+	_backoff.success();
+	pthread_mutex_unlock(&_mutex);
+}
+
+void vz::api::Circuit::failure(time_t now) {
+	pthread_mutex_lock(&_mutex);
+	_failures++;
+	_probing = false;
+
+	if (_state == circuit_half_open || (_threshold > 0 && _failures >= _threshold && _state == circuit_closed)) {
+		_state = circuit_open;
+		_backoff.failure(now);
+		print(log_warning, "Pausing all requests to middleware %s for %li secs after %u failures", "push",
+					_host.c_str(), (long) (_backoff.retry_at() - now), _failures);
+	}
+	pthread_mutex_unlock(&_mutex);
+}
+
+time_t vz::api::Circuit::retry_at() {
+	time_t at = 0;
+
+	pthread_mutex_lock(&_mutex);
+	if (_state == circuit_open) {
+		at = _backoff.retry_at();
+	}
+	pthread_mutex_unlock(&_mutex);
+
+	return at;
+}
+
+/*
+ * Local variables:
+ *  tab-width: 2
+ *  c-indent-level: 2
+ *  c-basic-offset: 2
+ *  project-name: vzlogger
+ * End:
+ */
@@ -0,0 +1,159 @@
+/**
+ * Content-Encoding of request bodies
+ *
+ * @copyright Copyright (c) 2011, The volkszaehler.org project
+ * @package vzlogger
+ * @license http://opensource.org/licenses/gpl-license.php GNU Public License
+ */
+/*
+ * This file is part of volkzaehler.org
+ *
+ * volkzaehler.org is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * volkzaehler.org is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include <VZException.hpp>
+#include <api/Compression.hpp>
+#include <common.h>
+
+vz::api::Compression::Compression(const std::list<Option> &options)
+		: _encoding(encoding_none)
+		, _min_size(COMPRESSION_DEFAULT_MIN_SIZE)
+		, _level(COMPRESSION_DEFAULT_LEVEL)
+		, _initialized(false)
+		, _headers(NULL)
+{
+	OptionList optlist;
+
+	try {
+		const char *encoding = optlist.lookup_string(options, "compression");
+
+		if (strcmp(encoding, "gzip") == 0) {
+			_encoding = encoding_gzip;
+		}
+		else if (strcmp(encoding, "deflate") == 0) {
+			_encoding = encoding_deflate;
+		}
+		else if (strcmp(encoding, "none") != 0) {
+			throw vz::VZException("Invalid compression.");
+		}
+	} catch (vz::OptionNotFoundException &e) {
+		/* send bodies as they are (default) */
+	} catch (vz::VZException &e) {
+		print(log_error, "Failed to parse compression", NULL);
+		throw;
+	}
+
+	try {
+		int size = optlist.lookup_int(options, "compression_min_size");
+		if (size < 0) throw vz::VZException("Compression min. size must not be negative.");
+		_min_size = size;
+	} catch (vz::OptionNotFoundException &e) {
+		/* use default */
+	} catch (vz::VZException &e) {
+		print(log_error, "Failed to parse compression_min_size", NULL);
+		throw;
+	}
+
+	try {
+		_level = optlist.lookup_int(options, "compression_level");
+		if (_level < 1 || _level > 9) throw vz::VZException("Compression level has to be between 1 and 9.");
+	} catch (vz::OptionNotFoundException &e) {
+		/* use default */
+	} catch (vz::VZException &e) {
+		print(log_error, "Failed to parse compression_level", NULL);
+		throw;
+	}
+}
+
+vz::api::Compression::~Compression() {
+	if (_initialized) {
+		deflateEnd(&_stream);
+	}
+	curl_slist_free_all(_headers);
+}
+
+bool vz::api::Compression::operator==(const Compression &other) const {
+	return _encoding == other._encoding && _min_size == other._min_size && _level == other._level;
+}
+
+void vz::api::Compression::post(CURL *curl, struct curl_slist *headers, const std::string &body, const char *name) {
+	if (enabled() && body.size() >= _min_size && compress(body)) {
+		if (_headers == NULL) { /* copy headers once and add the encoding */
+			for (struct curl_slist *it = headers; it != NULL; it = it->next) {
+				_headers = curl_slist_append(_headers, it->data);
+			}
+			_headers = curl_slist_append(_headers, (_encoding == encoding_gzip) ?
+																	 "Content-Encoding: gzip" : "Content-Encoding: deflate");
+		}
+
+		print(log_debug, "Compressed request body from %lu to %lu bytes", name,
+					(unsigned long) body.size(), (unsigned long) _buffer.size());
+
+		curl_easy_setopt(curl, CURLOPT_POSTFIELDS, _buffer.data());
+		curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long) _buffer.size());
+		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, _headers);
+	}
+	else {
+		curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body.c_str());
+		curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long) body.size());
+		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+	}
+}
+
+bool vz::api::Compression::compress(const std::string &body) {
+	int ret;
+
+	if (!_initialized) {
+		/* window bits + 16 writes a gzip instead of a zlib wrapper */
+		int bits = (_encoding == encoding_gzip) ? MAX_WBITS + 16 : MAX_WBITS;
+
+		memset(&_stream, 0, sizeof(_stream));
+		if (deflateInit2(&_stream, _level, Z_DEFLATED, bits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+			print(log_error, "Cannot initialize zlib: %s", NULL, _stream.msg ? _stream.msg : "unknown error");
+			return false;
+		}
+		_initialized = true;
+	}
+	else {
+		deflateReset(&_stream);
+	}
+
+	/* deflate in one pass, the bound covers incompressible input */
+	_buffer.resize(deflateBound(&_stream, body.size()));
+
+	_stream.next_in = (Bytef *) body.data();
+	_stream.avail_in = body.size();
+	_stream.next_out = (Bytef *) &_buffer[0];
+	_stream.avail_out = _buffer.size();
+
+	ret = deflate(&_stream, Z_FINISH);
+	if (ret != Z_STREAM_END) {
+		print(log_error, "Cannot compress request body: %s", NULL, _stream.msg ? _stream.msg : "buffer too small");
+		return false;
+	}
+
+	_buffer.resize(_stream.total_out);
+	return true;
+}
+
+/*
+ * Local variables:
+ *  tab-width: 2
+ *  c-indent-level: 2
+ *  c-basic-offset: 2
+ *  project-name: vzlogger
+ * End:
+ */
@@ -0,0 +1,169 @@
+/**
+ * Streaming JSON writer for request bodies
+ *
+ * @copyright Copyright (c) 2011, The volkszaehler.org project
+ * @package vzlogger
+ * @license http://opensource.org/licenses/gpl-license.php GNU Public License
+ */
+/*
+ * This file is part of volkzaehler.org
+ *
+ * volkzaehler.org is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * volkzaehler.org is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <api/JsonWriter.hpp>
+#include <VZException.hpp>
+
+/**
+ * Format the decimal digits of value backwards, ending at end
+ *
+ * @return first digit
+ */
+static char *format_digits(char *end, uint64_t value) {
+	do {
+		*--end = '0' + value % 10;
+		value /= 10;
+	} while (value > 0);
+
+	return end;
+}
+
+vz::api::JsonWriter::JsonWriter(std::string &buffer)
+		: _buffer(buffer)
+		, _depth(0)
+		, _first(1)
+		, _key(false)
+{
+	_buffer.clear(); /* keeps the capacity */
+}
+
+void vz::api::JsonWriter::key(const char *name) {
+	string(name);
+	_buffer += ':';
+	_key = true;
+}
+
+void vz::api::JsonWriter::string(const char *str) {
+	_value();
+	_buffer += '"';
+
+	for (const char *p = str; *p; p++) {
+		unsigned char c = *p;
+
+		if (c == '"' || c == '\\') {
+			_buffer += '\\';
+			_buffer += c;
+		}
+		else if (c < 0x20) { /* control characters */
+			char esc[8];
+			snprintf(esc, sizeof(esc), "\\u%04x", c);
+			_buffer += esc;
+		}
+		else {
+			_buffer += c;
+		}
+	}
+
+	_buffer += '"';
+}
+
+void vz::api::JsonWriter::number(int64_t value) {
+	char buf[24];
+	char *end = buf + sizeof(buf);
+	char *p = format_digits(end, (value < 0) ? -(uint64_t) value : value);
+
+	if (value < 0) *--p = '-';
+
+	_value();
+	_buffer.append(p, end - p);
+}
+
+void vz::api::JsonWriter::number(double value) {
+	char buf[32];
+
+	if (!isfinite(value)) {
+		_value();
+		_buffer += "null"; /* not representable in JSON */
+		return;
+	}
+
+	if (value == floor(value) && fabs(value) < 1e15) { /* integral, no rounding possible */
+		number((int64_t) value);
+		return;
+	}
+
+	/* the shortest of 15, 16 and 17 significant digits which reads back exactly */
+	for (int precision = 15; precision <= 17; precision++) {
+		snprintf(buf, sizeof(buf), "%.*g", precision, value);
+		if (strtod(buf, NULL) == value) break;
+	}
+
+	_value();
+	_buffer += buf;
+}
+
+void vz::api::JsonWriter::number(int64_t mantissa, int exponent) {
+	char buf[24];
+	char *end = buf + sizeof(buf);
+	char *p = format_digits(end, (mantissa < 0) ? -(uint64_t) mantissa : mantissa);
+	size_t digits = end - p;
+
+	_value();
+	if (mantissa < 0) _buffer += '-';
+
+	if (exponent >= 0) {
+		_buffer.append(p, digits);
+		if (mantissa != 0) _buffer.append(exponent, '0');
+	}
+	else if (digits > (size_t) -exponent) {
+		_buffer.append(p, digits + exponent);
+		_buffer += '.';
+		_buffer.append(end + exponent, -exponent);
+	}
+	else { /* leading zeros */
+		_buffer += "0.";
+		_buffer.append(-exponent - digits, '0');
+		_buffer.append(p, digits);
+	}
+}
+
+void vz::api::JsonWriter::tuple(const Reading &rd) {
+	begin_array();
+
+	/* API requires milliseconds */
+	number(rd.tvtoms());
+
+	if (rd.exact()) {
+		number(rd.mantissa(), rd.exponent());
+	}
+	else {
+		number(rd.value());
+	}
+
+	end_array();
+}
+
+/*
+ * Local variables:
+ *  tab-width: 2
+ *  c-indent-level: 2
+ *  c-basic-offset: 2
+ *  project-name: vzlogger
+ * End:
+ */
@@ -52,7 +52,9 @@ vz::api::MySmartGrid::MySmartGrid(
 		, _channelType(chn_type_device)
 		, _scaler(1)
 		, _response(new vz::api::CurlResponse())
+		, _backoff(options.retry_pause(), options.retry_max())
 		, _first_ts(0)
+		, _batch_ts(0)
 		, _first_counter(0)
 		, _last_counter(0)
 
@@ -102,6 +104,7 @@ vz::api::MySmartGrid::MySmartGrid(
 		throw;
 	}
 	convertUuid(channel()->uuid());
+	_circuit = Circuit::host(_middleware);
 
 	switch(_channelType) {
 			case chn_type_device:
@@ -144,10 +147,9 @@ vz::api::MySmartGrid::~MySmartGrid()
 
 void vz::api::MySmartGrid::send() 
 {
-	json_object *json_obj;
+	json_object *json_obj = NULL;
 	char digest[255];
 
-	const char *json_str;
 	long int http_code;
 	CURLcode curl_code;
 
@@ -162,44 +164,55 @@ void vz::api::MySmartGrid::send()
 	} else { // _first_ts = 0
 	}
 
+	if (_backoff.retry_at() > now || !_circuit->allow(now)) {
+		print(log_debug, "api-MySmartGrid, waiting to retry.", channel()->name());
+		return;
+	}
+
 	switch(_channelType) {
 			case chn_type_device:
 				json_obj = _apiDevice(channel()->buffer());
+				_body = (json_obj) ? json_object_to_json_string(json_obj) : "";
+				json_object_put(json_obj);
 				break;
 			case chn_type_sensor:
-				json_obj = _apiSensor(channel()->buffer());
+				_apiSensor(channel()->buffer());
 				break;
 	}
-	json_str = json_object_to_json_string(json_obj);
-	if(json_str == NULL || strcmp(json_str, "null")==0) {
+	if (_body.empty()) {
 		print(log_debug, "JSON request body is null. Nothing to send now.", channel()->name());
 		return;
 	}
 	
-	print(log_debug, "JSON request body: '%s'", channel()->name(), json_str);
+	print(log_debug, "JSON request body: '%s'", channel()->name(), _body.c_str());
 
 /* initialize response */
 	_response->clear_response();
 
-	curl_easy_setopt(_curlIF.handle(), CURLOPT_POSTFIELDS, json_str);
+	curl_easy_setopt(_curlIF.handle(), CURLOPT_POSTFIELDS, _body.c_str());
 
 	_api_header();
-	hmac_sha1(digest, (const unsigned char*)json_str, strlen(json_str));
+	hmac_sha1(digest, (const unsigned char*)_body.data(), _body.size());
 	_curlIF.addHeader(digest);
 	print(log_debug, "Header_Digest: %s", channel()->name(), digest);
 
 	_curlIF.commitHeader();
 
+	_circuit->attempt();
 	curl_code = _curlIF.perform();
 	curl_easy_getinfo(_curlIF.handle(), CURLINFO_RESPONSE_CODE, &http_code);
+	_result(curl_code, http_code);
 
 /* check response */
 	if (curl_code == CURLE_OK && http_code == 200) { /* everything is ok */
 		print(log_debug, "Request succeeded with code: %i", channel()->name(), http_code);
-		_values.clear();
+		if (_channelType == chn_type_sensor) {
+			_first_ts = _batch_ts;
+		}
+		channel()->buffer()->clean(); /* acknowledge the batch */
 	}
 	else { /* error */
-		channel()->buffer()->undelete();
+		channel()->buffer()->undelete(); /* rewind, the batch is sent again */
 		if (curl_code != CURLE_OK) {
 			print(log_error, "CURL: %s", channel()->name(), curl_easy_strerror(curl_code));
 		}
@@ -212,15 +225,6 @@ void vz::api::MySmartGrid::send()
 		
 	}
 
-/* householding */
-	json_object_put(json_obj);
-
-	if (options.daemon() && (curl_code != CURLE_OK || http_code != 200)) {
-		print(log_info, "Waiting %i secs for next request due to previous failure",
-					channel()->name(), options.retry_pause());
-		sleep(options.retry_pause());
-	}
-//sleep(20);
 }
 
 void vz::api::MySmartGrid::register_device() {
@@ -290,16 +294,16 @@ void vz::api::MySmartGrid::_send(
 
 	_curlIF.commitHeader();
 
+	_circuit->attempt();
 	curl_code = _curlIF.perform();
 	curl_easy_getinfo(_curlIF.handle(), CURLINFO_RESPONSE_CODE, &http_code);
+	_result(curl_code, http_code);
 
 	/* check response */
 	if (curl_code == CURLE_OK && http_code == 200) { /* everything is ok */
 		print(log_debug, "Request succeeded with code: %i", channel()->name(), http_code);
-		_values.clear();
 	}
 	else { /* error */
-		channel()->buffer()->undelete();
 		if (curl_code != CURLE_OK) {
 			print(log_error, "CURL: %s", channel()->name(), curl_easy_strerror(curl_code));
 		}
@@ -314,11 +318,26 @@ void vz::api::MySmartGrid::_send(
 
 	/* householding */
 	json_object_put(json_obj);
+}
+
+void vz::api::MySmartGrid::_result(CURLcode curl_code, long int http_code) {
+	time_t now = time(NULL);
+
+	/* the middleware is up if it answers, even if it rejects our readings */
+	if (curl_code == CURLE_OK && http_code < 500) {
+		_circuit->success();
+	} else {
+		_circuit->failure(now);
+	}
 
-	if (options.daemon() && (curl_code != CURLE_OK || http_code != 200)) {
-		print(log_info, "Waiting %i secs for next request due to previous failure",
-					channel()->name(), options.retry_pause());
-		sleep(options.retry_pause());
+	if (curl_code == CURLE_OK && http_code == 200) {
+		_backoff.success();
+	}
+	else {
+		/* the readings stay in the buffer, they are sent with a later request */
+		_backoff.failure(now);
+		print(log_info, "Waiting %li secs for next request due to %u failures",
+					channel()->name(), (long) (_backoff.retry_at() - now), _backoff.failures());
 	}
 }
 
@@ -359,13 +378,10 @@ void vz::api::MySmartGrid::api_parse_exception(char *err, size_t n) {
 
 json_object *vz::api::MySmartGrid::_apiDevice(Buffer::Ptr buf) {
 
-	// copy all values to local buffer queue
+	// readings are released once the heartbeat has been sent
 	buf->lock();
-	for (	Buffer::iterator it = buf->begin(); it != buf->end(); it++) {
-		it->mark_delete();
-	}
+	buf->mark_sent(buf->end());
 	buf->unlock();
-	buf->clean();
 
 	if(_first_ts>0) { // send lifesign
 		_first_ts = time(NULL);
@@ -376,9 +392,10 @@ json_object *vz::api::MySmartGrid::_apiDevice(Buffer::Ptr buf) {
 	}
 }
 
-json_object *vz::api::MySmartGrid::_apiSensor(Buffer::Ptr buf) {
+bool vz::api::MySmartGrid::_apiSensor(Buffer::Ptr buf) {
+	JsonWriter writer(_body);
 
-	return _json_object_measurements(buf);
+	return _json_measurements(buf, writer);
 }
 
 
@@ -489,77 +506,66 @@ json_object * vz::api::MySmartGrid::_json_object_sensor(
  * @brief MySmartGrid sensor measurements message
 
  @param[in] buf   
+ @param[in] writer  message is streamed to the writer
 
- @return <ReturnValue>
+ @return false if there are not enough values to send
 **/
 /*---------------------------------------------------------------------*/
-json_object * vz::api::MySmartGrid::_json_object_measurements(Buffer::Ptr buf) {
+bool vz::api::MySmartGrid::_json_measurements(Buffer::Ptr buf, JsonWriter &writer) {
 //  measurements: [[<timestamp1>,<value1>], [<timestamp2>,<value2>], ... ,[<timestamp n>,<value n>]]
-	json_object *json_obj    = json_object_new_object();
-	json_object *json_tuples = json_object_new_array();
 	Buffer::iterator it;
-
-//long last_counter = 0;
-
 	long timestamp = 0;
-	long value     = 0.0;
-
-	//print(log_debug, "MSG-API, buffer has %d element.", channel()->name(), buf->size());
-	if(_values.size() ) {
-		timestamp = _values.back().tvtod();
-		value     = _values.back().value();
-	}
+	size_t count = 0;
 
-	// copy all values to local buffer queue
+	// the batch stays in the buffer until the request succeeded
 	buf->lock();
-	for (it = buf->begin(); it != buf->end(); it++) {
-		if(timestamp < (long)it->tvtod() /*&& value != (long)(it->value() * _scaler)*/ ) {
-			_values.push_back(*it);
+	buf->mark_sent(buf->end());
+	for (it = buf->begin(); it != buf->sent(); it++) {
+		if (timestamp < (long)it->tvtod()) {
 			timestamp = it->tvtod();
-			value     = it->value() * _scaler;
+			count++;
+			print(log_debug, "==> %ld, %lf - %ld", channel()->name(), timestamp, it->value(), (long) (it->value() * _scaler));
 		}
-		it->mark_delete();
 	}
-	buf->unlock();
-	buf->clean();
 
-	//print(log_debug, "Valuescounter: %d", channel()->name(), _values.size());
-	
-	for (it = _values.begin(); it != _values.end(); it++) {
-		timestamp = it->tvtod();
-		value     = it->value() * _scaler;
-		print(log_debug, "==> %ld, %lf - %ld", channel()->name(), timestamp, it->value(), value);
+	if (count < 1 || (count < 2 && _first_counter==0) ) {
+		buf->unlock();
+		return false;
 	}
-	if(_values.size() < 1 || (_values.size() < 2 && _first_counter==0) ) {
-		return NULL;
-	}
-	
 
-	for (it = _values.begin(); it != _values.end(); it++) {
-		struct json_object *json_tuple = json_object_new_array();
+	writer.begin_object();
+	writer.key("measurements");
+	writer.begin_array();
 
-		// TODO use long int of new json-c version
-		// API requires milliseconds => * 1000
-		long timestamp = it->tvtod();
+	timestamp = 0;
+	_batch_ts = _first_ts;
+	for (it = buf->begin(); it != buf->sent(); it++) {
+		if (timestamp >= (long)it->tvtod()) {
+			continue; /* not newer than the previous reading */
+		}
+		timestamp = it->tvtod();
 		long value = it->value() * _scaler;
 
 		if( _first_counter < 1 ) {
 			_first_counter = value;
 			_last_counter = value;
 		} else {
-			if ( /*(_last_counter < value)  &&*/ (_first_ts < timestamp)) {
-				_first_ts = timestamp;
-				json_object_array_add(json_tuple, json_object_new_int(timestamp));
-				json_object_array_add(json_tuple, json_object_new_int(value-_first_counter));
-				json_object_array_add(json_tuples, json_tuple);
+			if ( /*(_last_counter < value)  &&*/ (_batch_ts < timestamp)) {
+				_batch_ts = timestamp;
+				writer.begin_array();
+				writer.number((int64_t) timestamp);
+				writer.number((int64_t) (value-_first_counter));
+				writer.end_array();
 				_last_counter = value;
 			} //else return NULL;
 		}
 	}
+	buf->unlock();
 
-	json_object_object_add(json_obj, "measurements", json_tuples);
+	writer.end_array();
+	writer.end_object();
 
-	return json_obj;
+	return true;
 }
 
 void vz::api::MySmartGrid::_api_header() {
@@ -0,0 +1,326 @@
+/**
+ * Shared uploader for volkszaehler.org middleware channels
+ *
+ * @author Kai Krueger <kai.krueger@itwm.fraunhofer.de>
+ * @copyright Copyright (c) 2011, The volkszaehler.org project
+ * @package vzlogger
+ * @license http://opensource.org/licenses/gpl-license.php GNU Public License
+ */
+/*
+ * This file is part of volkzaehler.org
+ *
+ * volkzaehler.org is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * volkzaehler.org is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include <VZException.hpp>
+#include "Config_Options.hpp"
+#include <api/Uploader.hpp>
+
+extern Config_Options options;
+
+vz::api::Uploader &vz::api::Uploader::instance() {
+	static Uploader uploader;
+	return uploader;
+}
+
+vz::api::Uploader::Uploader()
+		: _stop(0)
+		, _thread_running(false)
+{
+	_multi = curl_multi_init();
+	_share = curl_share_init();
+	if (!_multi || !_share) {
+		throw vz::VZException("CURL: cannot create multi handle.");
+	}
+
+	/* connections are cached by the multi handle, share dns and tls sessions too */
+	curl_share_setopt(_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+	curl_share_setopt(_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+
+	curl_multi_setopt(_multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long) UPLOADER_MAX_HOST_CONNECTIONS);
+#ifdef CURLPIPE_MULTIPLEX
+	curl_multi_setopt(_multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+#endif
+
+	if (pipe(_wakeup) < 0) {
+		throw vz::VZException("Uploader: cannot create wakeup pipe.");
+	}
+	fcntl(_wakeup[0], F_SETFL, O_NONBLOCK);
+	fcntl(_wakeup[1], F_SETFL, O_NONBLOCK);
+}
+
+vz::api::Uploader::~Uploader() {
+	cancel();
+
+	for (std::list<upload_t>::iterator it = _uploads.begin(); it != _uploads.end(); it++) {
+		if (busy(*it)) {
+			curl_multi_remove_handle(_multi, handle(*it));
+		}
+		curl_easy_setopt(handle(*it), CURLOPT_SHARE, NULL);
+	}
+	_uploads.clear();
+
+	curl_multi_cleanup(_multi);
+	curl_share_cleanup(_share);
+	close(_wakeup[0]);
+	close(_wakeup[1]);
+}
+
+void vz::api::Uploader::add(Channel::Ptr ch) {
+	upload_t upload;
+
+	if (running()) {
+		throw vz::VZException("Uploader: cannot add channels while running.");
+	}
+
+	if (options.spool() != "") { /* keep readings on disk until the middleware acknowledged them */
+		try {
+			ch->spool(Spool::Ptr(new Spool(options.spool() + "/" + ch->uuid(), options.spool_size() * 1024,
+																		 (Spool::sync_t) options.spool_sync(), options.spool_sync_interval())));
+		} catch (vz::VZException &e) {
+			print(log_error, "Cannot open spool, buffering in memory: %s", ch->name(), e.what());
+		}
+	}
+
+	upload.api = vz::shared_ptr<Volkszaehler>(new Volkszaehler(ch, ch->options()));
+	upload.group = NULL;
+
+	if (upload.api->bulk()) {
+		for (std::list<upload_t>::iterator it = _uploads.begin(); it != _uploads.end(); it++) {
+			if (it->bulk && it->bulk->middleware() == upload.api->middleware()) {
+				upload.group = it->bulk.get();
+			}
+		}
+
+		if (upload.group == NULL) { /* first bulk channel of this middleware */
+			upload_t group;
+			group.bulk = VolkszaehlerBulk::Ptr(new VolkszaehlerBulk(upload.api->middleware(),
+																															upload.api->timeout(), ch.get()));
+			group.group = NULL;
+			_uploads.push_back(group);
+			attach(_uploads.back());
+
+			upload.group = group.bulk.get();
+		}
+
+		upload.group->add(upload.api);
+	}
+
+	_uploads.push_back(upload);
+	attach(_uploads.back());
+
+	print(log_debug, "Attached to shared uploader (middleware=%s, bulk=%s)", ch->name(),
+				upload.api->middleware().c_str(), upload.api->bulk() ? "yes" : "no");
+}
+
+void vz::api::Uploader::attach(upload_t &upload) {
+	curl_easy_setopt(handle(upload), CURLOPT_SHARE, _share);
+	curl_easy_setopt(handle(upload), CURLOPT_PRIVATE, &upload);
+}
+
+void vz::api::Uploader::start() {
+	if (running() || _uploads.empty()) {
+		return;
+	}
+
+	pthread_create(&_thread, NULL, &thread, (void *) this);
+	_thread_running = true;
+	print(log_debug, "Uploader thread started for %lu channels", "push", _uploads.size());
+}
+
+void vz::api::Uploader::cancel() {
+	if (running()) {
+		stop(); /* let the mainloop finish its current step instead of cancelling curl */
+		pthread_join(_thread, NULL);
+		_thread_running = false;
+
+		flush();
+	}
+}
+
+void vz::api::Uploader::flush() {
+	int running = 0;
+
+	/* requests interrupted by cancel() are sent again */
+	for (std::list<upload_t>::iterator it = _uploads.begin(); it != _uploads.end(); it++) {
+		if (busy(*it)) {
+			curl_multi_remove_handle(_multi, handle(*it));
+			if (it->bulk) {
+				it->bulk->complete(CURLE_ABORTED_BY_CALLBACK);
+			} else {
+				it->api->complete(CURLE_ABORTED_BY_CALLBACK);
+			}
+		}
+	}
+
+	for (std::list<upload_t>::iterator it = _uploads.begin(); it != _uploads.end(); it++) {
+		if (it->group && !it->group->split()) {
+			continue; /* uploaded by its bulk group */
+		}
+
+		try {
+			bool ready = (it->bulk) ? it->bulk->prepare(true) : it->api->prepare(true);
+
+			if (ready) {
+				curl_multi_add_handle(_multi, handle(*it));
+				running++;
+			}
+		}
+		catch (std::exception &e) {
+			print(log_error, "Uploader failed to prepare request: %s", "push", e.what());
+		}
+	}
+
+	if (running > 0) {
+		print(log_info, "Flushing pending readings of %i uploads", "push", running);
+	}
+
+	/* single attempt, bounded by the curl timeout of each request */
+	while (running > 0) {
+		curl_multi_perform(_multi, &running);
+		complete();
+
+		if (running > 0) {
+			curl_multi_wait(_multi, NULL, 0, 1000, NULL);
+		}
+	}
+	complete();
+}
+
+void vz::api::Uploader::wakeup() {
+	char byte = 0;
+
+	/* pipe is non-blocking, a full pipe already wakes the uploader */
+	if (write(_wakeup[1], &byte, 1) < 0) {}
+}
+
+void vz::api::Uploader::stop() {
+	_stop = 1;
+	wakeup();
+}
+
+void * vz::api::Uploader::thread(void *arg) {
+	Uploader *uploader = static_cast<Uploader *>(arg);
+
+	uploader->run();
+
+	pthread_exit(0);
+	return NULL;
+}
+
+void vz::api::Uploader::run() {
+	int running = 0;
+
+	do { /* start thread mainloop */
+		int timeout = schedule();
+
+		curl_multi_perform(_multi, &running);
+		if (complete() > 0) {
+			continue; /* finished channels may have new readings already */
+		}
+
+		/* sleep until sockets are ready, new readings arrive or a retry is due */
+		struct curl_waitfd wfd;
+		wfd.fd = _wakeup[0];
+		wfd.events = CURL_WAIT_POLLIN;
+		wfd.revents = 0;
+
+		curl_multi_wait(_multi, &wfd, 1, timeout * 1000, NULL);
+
+		if (wfd.revents) {
+			char buf[64];
+			while (read(_wakeup[0], buf, sizeof(buf)) > 0);
+		}
+	} while (options.logging() && !_stop);
+
+	print(log_debug, "Stop uploading.! (daemon=%d)", "push", options.daemon());
+}
+
+int vz::api::Uploader::schedule() {
+	time_t now = time(NULL);
+	int timeout = UPLOADER_IDLE_TIMEOUT;
+
+	for (std::list<upload_t>::iterator it = _uploads.begin(); it != _uploads.end(); it++) {
+		if (busy(*it) || (it->group && !it->group->split())) {
+			continue; /* in flight or uploaded by its bulk group */
+		}
+
+		try {
+			bool ready = (it->bulk) ? it->bulk->prepare() : it->api->prepare();
+
+			if (ready) {
+				curl_multi_add_handle(_multi, handle(*it));
+			}
+			else if (retry_at(*it) > now && retry_at(*it) - now < timeout) {
+				timeout = retry_at(*it) - now;
+			}
+			else if (it->bulk && it->bulk->split() && it->bulk->split_until() - now < timeout) {
+				timeout = it->bulk->split_until() - now; /* resume bulk mode in time */
+			}
+			else if (due_at(*it) > now && due_at(*it) - now < timeout) {
+				timeout = due_at(*it) - now; /* batch is held back */
+			}
+		}
+		catch (std::exception &e) {
+			print(log_error, "Uploader failed to prepare request: %s", "push", e.what());
+		}
+	}
+
+	return timeout;
+}
+
+int vz::api::Uploader::complete() {
+	CURLMsg *msg;
+	int left, done = 0;
+
+	while ((msg = curl_multi_info_read(_multi, &left)) != NULL) {
+		if (msg->msg != CURLMSG_DONE) {
+			continue;
+		}
+
+		upload_t *upload;
+		curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **) &upload);
+		CURLcode curl_code = msg->data.result;
+
+		/* msg is invalidated by removing the handle */
+		curl_multi_remove_handle(_multi, handle(*upload));
+		done++;
+
+		try {
+			if (upload->bulk) {
+				upload->bulk->complete(curl_code);
+			} else {
+				upload->api->complete(curl_code);
+			}
+		}
+		catch (std::exception &e) {
+			print(log_error, "Uploader failed to evaluate response: %s", "push", e.what());
+		}
+	}
+
+	return done;
+}
+
+/*
+ * Local variables:
+ *  tab-width: 2
+ *  c-indent-level: 2
+ *  c-basic-offset: 2
+ *  project-name: vzlogger
+ * End:
+ */
@@ -34,6 +34,7 @@
 #include <sys/time.h>
 #include <math.h>
 #include <unistd.h>
+#include <algorithm>
 
 #include <VZException.hpp>
 #include "Config_Options.hpp"
@@ -46,10 +47,23 @@ vz::api::Volkszaehler::Volkszaehler(
   std::list<Option> pOptions
 	) 
 		: ApiIF(ch)
+    , _compression(pOptions)
+    , _spooled(SPOOL_BATCH)
+    , _queued(0)
+    , _from_spool(false)
+    , _skip(0)
     , _last_timestamp(0)
+    , _batch_timestamp(0)
+    , _backoff(options.retry_pause(), options.retry_max())
+    , _busy(false)
+    , _batch_size(1)
+    , _batch_age(0)
+    , _batch_interval(0)
+    , _queued_since(0)
+    , _last_request(0)
 {
 	OptionList optlist;
-	char url[255], agent[255];
+	char url[255];
   unsigned short curlTimeout = 30; // 30 seconds
 
 /* parse options */
@@ -70,70 +84,137 @@ vz::api::Volkszaehler::Volkszaehler(
 		throw;
 	}
 
-/* prepare header, uuid & url */
-	sprintf(agent, "User-Agent: %s/%s (%s)", PACKAGE, VERSION, curl_version());     /* build user agent */
-	sprintf(url, "%s/data/%s.json", middleware().c_str(), channel()->uuid());                        /* build url */
+	try {
+		_bulk = optlist.lookup_bool(pOptions, "bulk");
+	} catch ( vz::OptionNotFoundException &e ) {
+		_bulk = false; /* one request per channel (default) */
+	} catch ( vz::VZException &e ) {
+		throw;
+	}
 
-	_api.headers = NULL;
-	_api.headers = curl_slist_append(_api.headers, "Content-type: application/json");
-	_api.headers = curl_slist_append(_api.headers, "Accept: application/json");
-	_api.headers = curl_slist_append(_api.headers, agent);
+	try {
+		int size = optlist.lookup_int(pOptions, "batch_size");
+		if (size < 1) throw vz::VZException("Batch size has to be positive.");
+		_batch_size = size;
+	} catch ( vz::OptionNotFoundException &e ) {
+		/* send each reading immediately (default) */
+	} catch ( vz::VZException &e ) {
+		print(log_error, "Failed to parse batch_size", channel()->name());
+		throw;
+	}
 
-	_api.curl = curl_easy_init();
-	if (!_api.curl) {
-		throw vz::VZException("CURL: cannot create handle.");
+	try {
+		_batch_age = optlist.lookup_int(pOptions, "batch_age");
+		if (_batch_age < 0) throw vz::VZException("Batch age must not be negative.");
+	} catch ( vz::OptionNotFoundException &e ) {
+		/* no limit */
+	} catch ( vz::VZException &e ) {
+		print(log_error, "Failed to parse batch_age", channel()->name());
+		throw;
 	}
 
-	curl_easy_setopt(_api.curl, CURLOPT_URL, url);
-	curl_easy_setopt(_api.curl, CURLOPT_HTTPHEADER, _api.headers);
-	curl_easy_setopt(_api.curl, CURLOPT_VERBOSE, options.verbosity());
-	curl_easy_setopt(_api.curl, CURLOPT_DEBUGFUNCTION, curl_custom_debug_callback);
-	curl_easy_setopt(_api.curl, CURLOPT_DEBUGDATA, channel().get());
+	try {
+		_batch_interval = optlist.lookup_int(pOptions, "batch_interval");
+		if (_batch_interval < 0) throw vz::VZException("Batch interval must not be negative.");
+	} catch ( vz::OptionNotFoundException &e ) {
+		/* no limit */
+	} catch ( vz::VZException &e ) {
+		print(log_error, "Failed to parse batch_interval", channel()->name());
+		throw;
+	}
 
-  // signal-handling in libcurl is NOT thread-safe. so force to deactivated them!
-  curl_easy_setopt(_api.curl, CURLOPT_NOSIGNAL, 1);
+	if (_batch_size > 1 && _batch_age == 0) {
+		print(log_warning, "Readings may be held indefinitely, consider setting batch_age", channel()->name());
+	}
 
-  // set timeout to 5 sec. required if next router has an ip-change.
-  curl_easy_setopt(_api.curl, CURLOPT_TIMEOUT, curlTimeout);
+	_timeout = curlTimeout;
+	_circuit = Circuit::host(_middleware);
+
+/* prepare uuid & url */
+	sprintf(url, "%s/data/%s.json", middleware().c_str(), channel()->uuid());                        /* build url */
+
+	api_init(&_api, url, curlTimeout, channel().get());
+
+	_response.data = NULL;
+	_response.size = 0;
 }
 
 vz::api::Volkszaehler::~Volkszaehler() 
 {
+	curl_easy_cleanup(_api.curl);
+	curl_slist_free_all(_api.headers);
+	free(_response.data);
 }
 
 void vz::api::Volkszaehler::send() 
 {
-	CURLresponse response;
-	json_object *json_obj;
+	if (!prepare()) {
+		return;
+	}
 
-	const char *json_str;
-	long int http_code;
-	CURLcode curl_code;
+	CURLcode curl_code = curl_easy_perform(curl());
 
-	/* initialize response */
-	response.data = NULL;
-	response.size = 0;
+	complete(curl_code); /* a failed request is retried with the next call after retry_at() */
+}
 
-	json_obj = api_json_tuples(channel()->buffer());
-	json_str = json_object_to_json_string(json_obj);
-	if(json_str == NULL || strcmp(json_str, "null")==0) {
+bool vz::api::Volkszaehler::prepare(bool flush)
+{
+	time_t now = time(NULL);
+
+	/* keep draining the buffer while waiting, so it does not fill up */
+	if (collect() < 1) {
 		print(log_debug, "JSON request body is null. Nothing to send now.", channel()->name());
-		return;
+		return false;
+	}
+
+	if (!flush && (_backoff.retry_at() > now || !_circuit->allow(now))) {
+		return false;
+	}
+
+	if (!flush && !due(now)) {
+		return false;
 	}
 
-	print(log_debug, "JSON request body: %s", channel()->name(), json_str);
+	/* initialize response */
+	free(_response.data);
+	_response.data = NULL;
+	_response.size = 0;
+
+	JsonWriter writer(_body);
+	json_tuples(writer);
+	requested(now);
+
+	print(log_debug, "JSON request body: %s", channel()->name(), _body.c_str());
 
-	curl_easy_setopt(curl(), CURLOPT_POSTFIELDS, json_str);
+	_compression.post(curl(), _api.headers, _body, channel()->name());
 	curl_easy_setopt(curl(), CURLOPT_WRITEFUNCTION, curl_custom_write_callback);
-	curl_easy_setopt(curl(), CURLOPT_WRITEDATA, (void *) &response);
+	curl_easy_setopt(curl(), CURLOPT_WRITEDATA, (void *) &_response);
+
+	_circuit->attempt();
+	_busy = true;
+	return true;
+}
+
+bool vz::api::Volkszaehler::complete(CURLcode curl_code)
+{
+	long int http_code = 0;
+	time_t now = time(NULL);
 
-	curl_code = curl_easy_perform(curl());
 	curl_easy_getinfo(curl(), CURLINFO_RESPONSE_CODE, &http_code);
+	_busy = false;
+
+	/* the middleware is up if it answers, even if it rejects our readings */
+	if (curl_code == CURLE_OK && http_code < 500) {
+		_circuit->success();
+	} else {
+		_circuit->failure(now);
+	}
 
 	/* check response */
 	if (curl_code == CURLE_OK && http_code == 200) { /* everything is ok */
 		print(log_debug, "CURL Request succeeded with code: %i", channel()->name(), http_code);
-		_values.clear();
+		_backoff.success();
+		accepted();
 		//clear buffer-readings
 //channel()->buffer.sent = last->next;
 	}
@@ -143,68 +224,144 @@ void vz::api::Volkszaehler::send()
 		}
 		else if (http_code != 200) {
 			char err[255];
-			api_parse_exception(response, err, 255);
+			api_parse_exception(_response, err, 255);
 			print(log_error, "CURL Error from middleware: %s", channel()->name(), err);
     }
+		rejected();
 	}
 
-	/* householding */
-	free(response.data);
-	json_object_put(json_obj);
+	if (curl_code != CURLE_OK || http_code != 200) {
+		/* queued readings stay unacknowledged and are sent again with the next request */
+		_backoff.failure(now);
+		print(log_info, "Waiting %li secs for next request due to %u failures",
+					channel()->name(), (long) (_backoff.retry_at() - now), _backoff.failures());
+		return false;
+	}
 
+	return (curl_code == CURLE_OK && http_code == 200);
+}
 
-	if (options.daemon() && (curl_code != CURLE_OK || http_code != 200)) {
-		print(log_info, "Waiting %i secs for next request due to previous failure",
-					channel()->name(), options.retry_pause());
-		sleep(options.retry_pause());
+void vz::api::Volkszaehler::register_device() {
+}
+
+
+size_t vz::api::Volkszaehler::collect() {
+	Buffer::Ptr buf = channel()->buffer();
+	Spool::Ptr spool = channel()->spool();
+	size_t queued = _queued;
+
+	print(log_debug, "==> number of tuples: %d", channel()->name(), buf->size());
+
+	if (channel()->spooling()) { /* readings are written through to the spool, the buffer is not needed */
+		buf->lock();
+		buf->mark_sent(buf->end());
+		buf->unlock();
+		buf->clean();
+	}
+
+	// only hold one batch of the spool in memory, a failed spool still holds its backlog
+	if (spool && (_from_spool || _queued == 0) && _queued < SPOOL_BATCH) {
+		size_t n = spool->read(&_spooled[_queued], SPOOL_BATCH - _queued, channel()->identifier());
+		if (n > 0) {
+			_from_spool = true;
+			_queued += n;
+		}
+	}
+
+	if (!channel()->spooling() && !_from_spool) { /* the batch stays in the buffer until it is acknowledged */
+		buf->lock();
+		buf->mark_sent(buf->end());
+		_queued = buf->pending();
+		buf->unlock();
+	}
+
+	if (queued == 0 && _queued > 0) {
+		_queued_since = time(NULL);
 	}
+
+	return _queued;
 }
 
-void vz::api::Volkszaehler::register_device() {
+void vz::api::Volkszaehler::accepted() {
+	if (_from_spool) {
+		channel()->spool()->ack();
+	} else {
+		channel()->buffer()->clean();
+	}
+
+	_last_timestamp = _batch_timestamp;
+	_queued = 0;
+	_from_spool = false;
+	_skip = 0;
+	_queued_since = 0;
 }
 
+void vz::api::Volkszaehler::rejected() {
+	if (!_from_spool) { /* a spooled batch is kept in _spooled */
+		channel()->buffer()->undelete();
+	}
+}
 
-json_object * vz::api::Volkszaehler::api_json_tuples(Buffer::Ptr buf) {
+bool vz::api::Volkszaehler::due(time_t now) {
+	time_t at = due_at();
 
-	json_object *json_tuples = json_object_new_array();
-	Buffer::iterator it;
+	return (at > 0 && at <= now);
+}
 
-	print(log_debug, "==> number of tuples: %d", channel()->name(), buf->size());
-	uint64_t timestamp = 1;
-
-	// copy all values to local buffer queue
-	buf->lock();
-	for (it = buf->begin(); it != buf->end(); it++) {
-    timestamp = round(it->tvtod() * 1000);
-    print(log_debug, "compare: %llu %llu %f", channel()->name(), _last_timestamp, timestamp, it->tvtod() * 1000);
-    if(_last_timestamp < timestamp ) {
-      _values.push_back(*it);
-      _last_timestamp = timestamp;
-    }
-    it->mark_delete();
+time_t vz::api::Volkszaehler::due_at() {
+	time_t at;
+
+	if (_queued == 0) {
+		return 0;
 	}
-	buf->unlock();
-	buf->clean();
 
-	if( _values.size() < 1 ) {
-		return NULL;
+	/* a spooled backlog is read in batches of SPOOL_BATCH readings */
+	if (_queued >= _batch_size || (_from_spool && _queued >= SPOOL_BATCH)) {
+		at = _queued_since;
+	}
+	else if (_batch_age > 0) {
+		at = _queued_since + _batch_age;
+	}
+	else {
+		return 0; /* wait for more readings */
 	}
 
-	for (it = _values.begin(); it != _values.end(); it++) {
-		struct json_object *json_tuple = json_object_new_array();
+	return std::max(at, _last_request + _batch_interval);
+}
 
-		// TODO use long int of new json-c version
-		// API requires milliseconds => * 1000
-		double timestamp = it->tvtod() * 1000; 
-		double value = it->value();
+void vz::api::Volkszaehler::json_tuples(JsonWriter &writer) {
+	uint64_t last = _last_timestamp;
+	size_t i = 0;
 
-		json_object_array_add(json_tuple, json_object_new_double(timestamp));
-		json_object_array_add(json_tuple, json_object_new_double(value));
+	writer.begin_array();
 
-		json_object_array_add(json_tuples, json_tuple);
+	if (_from_spool) {
+		for (; i < _queued; i++) {
+			tuple(writer, _spooled[i], i, last);
+		}
+	}
+	else {
+		Buffer::Ptr buf = channel()->buffer();
+
+		buf->lock();
+		for (Buffer::iterator it = buf->begin(); it != buf->sent(); it++, i++) {
+			tuple(writer, *it, i, last);
+		}
+		buf->unlock();
 	}
 
-	return json_tuples;
+	writer.end_array();
+	_batch_timestamp = last;
+}
+
+void vz::api::Volkszaehler::tuple(JsonWriter &writer, const Reading &rd, size_t i, uint64_t &last) {
+	uint64_t timestamp = rd.tvtoms(); /* same rounding as the uploaded timestamp */
+
+	/* skip readings the middleware already has and readings older than the last one */
+	if (i >= _skip && timestamp > last) {
+		writer.tuple(rd);
+		last = timestamp;
+	}
 }
 
 void vz::api::Volkszaehler::api_parse_exception(CURLresponse response, char *err, size_t n) {
@@ -226,7 +383,7 @@ void vz::api::Volkszaehler::api_parse_exception(CURLresponse response, char *err
       if( err_type == "PDOException") {
         if( err_message.find("Duplicate entry") ) {
           print(log_warning, "middle says duplicated value. removing first entry!", channel()->name());
-          _values.pop_front();
+          if (_skip < _queued) _skip++;
         }
       }
 		}
@@ -284,6 +441,38 @@ int vz::api::curl_custom_debug_callback(
 	return 0;
 }
 
+void vz::api::api_init(api_handle_t *api, const char *url, int timeout, Channel *ch) {
+	char agent[255];
+
+/* prepare header */
+	sprintf(agent, "User-Agent: %s/%s (%s)", PACKAGE, VERSION, curl_version());     /* build user agent */
+
+	api->headers = NULL;
+	api->headers = curl_slist_append(api->headers, "Content-type: application/json");
+	api->headers = curl_slist_append(api->headers, "Accept: application/json");
+	api->headers = curl_slist_append(api->headers, agent);
+
+	api->curl = curl_easy_init();
+	if (!api->curl) {
+		throw vz::VZException("CURL: cannot create handle.");
+	}
+
+	curl_easy_setopt(api->curl, CURLOPT_URL, url);
+	curl_easy_setopt(api->curl, CURLOPT_HTTPHEADER, api->headers);
+	curl_easy_setopt(api->curl, CURLOPT_VERBOSE, options.verbosity());
+	curl_easy_setopt(api->curl, CURLOPT_DEBUGFUNCTION, curl_custom_debug_callback);
+	curl_easy_setopt(api->curl, CURLOPT_DEBUGDATA, ch);
+
+  // signal-handling in libcurl is NOT thread-safe. so force to deactivated them!
+  curl_easy_setopt(api->curl, CURLOPT_NOSIGNAL, 1);
+
+  // set timeout to 5 sec. required if next router has an ip-change.
+  curl_easy_setopt(api->curl, CURLOPT_TIMEOUT, timeout);
+
+  // keep idle connections to the middleware open
+  curl_easy_setopt(api->curl, CURLOPT_TCP_KEEPALIVE, 1L);
+}
+
 size_t vz::api::curl_custom_write_callback(void *ptr, size_t size, size_t nmemb, void *data) {
 	size_t realsize = size * nmemb;
 	CURLresponse *response = static_cast<CURLresponse *>(data);
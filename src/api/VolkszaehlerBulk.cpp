@@ -0,0 +1,210 @@
+/**
+ * Bulk uploads for the volkszaehler.org middleware
+ *
+ * @author Kai Krueger <kai.krueger@itwm.fraunhofer.de>
+ * @copyright Copyright (c) 2011, The volkszaehler.org project
+ * @package vzlogger
+ * @license http://opensource.org/licenses/gpl-license.php GNU Public License
+ */
+/*
+ * This file is part of volkzaehler.org
+ *
+ * volkzaehler.org is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * volkzaehler.org is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include <VZException.hpp>
+#include "Config_Options.hpp"
+#include <api/VolkszaehlerBulk.hpp>
+
+extern Config_Options options;
+
+vz::api::VolkszaehlerBulk::VolkszaehlerBulk(
+	const std::string &middleware
+	, int timeout
+	, Channel *ch
+	)
+		: _middleware(middleware)
+		, _compression(ch->options())
+		, _backoff(options.retry_pause(), options.retry_max())
+		, _split_until(0)
+		, _busy(false)
+{
+	char url[255];
+
+	snprintf(url, sizeof(url), "%s/data.json", middleware.c_str());
+	api_init(&_api, url, timeout, ch);
+	_circuit = Circuit::host(middleware);
+
+	_response.data = NULL;
+	_response.size = 0;
+}
+
+vz::api::VolkszaehlerBulk::~VolkszaehlerBulk()
+{
+	curl_easy_cleanup(_api.curl);
+	curl_slist_free_all(_api.headers);
+	free(_response.data);
+}
+
+void vz::api::VolkszaehlerBulk::add(vz::shared_ptr<Volkszaehler> api)
+{
+	if (!(api->compression() == _compression)) { /* one body for all members */
+		print(log_error, "Compression settings differ from the other bulk channels of %s", api->name(),
+					_middleware.c_str());
+		throw vz::VZException("Bulk channels of a middleware need the same compression settings.");
+	}
+
+	_members.push_back(api);
+}
+
+bool vz::api::VolkszaehlerBulk::prepare(bool flush)
+{
+	time_t now = time(NULL);
+	bool due = flush;
+
+	if (!flush && split()) {
+		return false; /* members send single requests */
+	}
+
+	/* members with pending readings join the request as soon as one of them is due,
+	 * their buffers are drained while waiting as well */
+	for (std::vector<vz::shared_ptr<Volkszaehler> >::iterator it = _members.begin(); it != _members.end(); it++) {
+		if (!(*it)->busy() && (*it)->collect() > 0 && (*it)->due(now)) {
+			due = true;
+		}
+	}
+
+	if (!flush && (_backoff.retry_at() > now || !_circuit->allow(now))) {
+		return false;
+	}
+
+	if (!due) {
+		return false;
+	}
+
+	_inflight.clear();
+	JsonWriter writer(_body);
+	writer.begin_array();
+
+	for (std::vector<vz::shared_ptr<Volkszaehler> >::iterator it = _members.begin(); it != _members.end(); it++) {
+		if ((*it)->busy() || (*it)->collect() < 1) {
+			continue; /* single request still in flight or nothing to send */
+		}
+
+		writer.begin_object();
+		writer.key("uuid");
+		writer.string((*it)->uuid());
+		writer.key("tuples");
+		(*it)->json_tuples(writer);
+		(*it)->requested(now);
+		writer.end_object();
+
+		_inflight.push_back(it->get());
+	}
+
+	writer.end_array();
+
+	if (_inflight.empty()) {
+		return false;
+	}
+
+	/* initialize response */
+	free(_response.data);
+	_response.data = NULL;
+	_response.size = 0;
+
+	print(log_debug, "JSON bulk request body for %lu channels: %s", "push", _inflight.size(), _body.c_str());
+
+	_compression.post(curl(), _api.headers, _body, "push");
+	curl_easy_setopt(curl(), CURLOPT_WRITEFUNCTION, curl_custom_write_callback);
+	curl_easy_setopt(curl(), CURLOPT_WRITEDATA, (void *) &_response);
+
+	_circuit->attempt();
+	_busy = true;
+	return true;
+}
+
+bool vz::api::VolkszaehlerBulk::complete(CURLcode curl_code)
+{
+	long int http_code = 0;
+	time_t now = time(NULL);
+
+	curl_easy_getinfo(curl(), CURLINFO_RESPONSE_CODE, &http_code);
+	_busy = false;
+
+	if (curl_code == CURLE_OK && http_code < 500) {
+		_circuit->success();
+	} else {
+		_circuit->failure(now);
+	}
+
+	/* check response */
+	if (curl_code == CURLE_OK && http_code == 200) { /* everything is ok */
+		print(log_debug, "CURL Bulk request for %lu channels succeeded", "push", _inflight.size());
+		_backoff.success();
+
+		for (std::vector<Volkszaehler *>::iterator it = _inflight.begin(); it != _inflight.end(); it++) {
+			(*it)->accepted();
+		}
+		_inflight.clear();
+		return true;
+	}
+
+	if (curl_code != CURLE_OK) { /* middleware unreachable, retry all channels at once */
+		print(log_error, "CURL: %s", "push", curl_easy_strerror(curl_code));
+
+		_backoff.failure(now);
+		print(log_info, "Waiting %li secs for next bulk request due to %u failures",
+					"push", (long) (_backoff.retry_at() - now), _backoff.failures());
+	}
+	else { /* rejected, let each channel evaluate its own response */
+		print(log_error, "CURL Error from middleware for bulk request (code=%li): %.*s", "push",
+					http_code, (int) _response.size, _response.data ? _response.data : "");
+		print(log_info, "Sending single requests for %i secs", "push", options.retry_pause());
+		_split_until = now + options.retry_pause();
+	}
+
+	for (std::vector<Volkszaehler *>::iterator it = _inflight.begin(); it != _inflight.end(); it++) {
+		(*it)->rejected();
+	}
+	_inflight.clear();
+	return false;
+}
+
+time_t vz::api::VolkszaehlerBulk::due_at()
+{
+	time_t at = 0;
+
+	for (std::vector<vz::shared_ptr<Volkszaehler> >::iterator it = _members.begin(); it != _members.end(); it++) {
+		time_t member = (*it)->due_at();
+
+		if (member > 0 && (at == 0 || member < at)) {
+			at = member;
+		}
+	}
+
+	return at;
+}
+
+/*
+ * Local variables:
+ *  tab-width: 2
+ *  c-indent-level: 2
+ *  c-basic-offset: 2
+ *  project-name: vzlogger
+ * End:
+ */
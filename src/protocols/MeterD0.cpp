@@ -50,6 +50,12 @@ MeterD0::MeterD0(std::list<Option> options)
 		: Protocol("d0")
 		, _host("")
 		, _device("")
+		, _fd(-1)
+		, _context(START)
+		, _byte_iterator(0)
+		, _tuples(0)
+		, _pos(0)
+		, _len(0)
 {
 	OptionList optlist;
 
@@ -120,166 +126,184 @@ int MeterD0::close() {
 }
 
 ssize_t MeterD0::read(std::vector<Reading>&rds, size_t max_readings) {
+	bool complete = false;
 
-	enum { START, VENDOR, BAUDRATE, IDENTIFICATION, START_LINE, OBIS_CODE, VALUE, UNIT, END_LINE, END } context;
-
-	bool error_flag = false;
-	char vendor[3+1];		/* 3 upper case vendor + '\0' termination */
-	char identification[16+1];	/* 16 meter specific + '\0' termination */
-	char obis_code[16+1];		/* A-B:C.D.E*F
-														 fields A, B, E, F are optional
-														 fields C & D are mandatory
-														 A: energy type; 1: energy
-														 B: channel number; 0: no channel specified
-														 C: data items; 0-89 in COSEM context: IEC 62056-62, Clause D.1; 96: General service entries
-														 1:  Totel Active power+
-														 21: L1 Active power+
-														 31: L1 Current
-														 32: L1 Voltage
-														 41: L2 Active power+
-														 51: L2 Current
-														 52: L2 Voltage
-														 61: L3 Active power+
-														 71: L3 Current
-														 72: L3 Voltage
-														 96.1.255: Metering point ID 256 (electricity related) 
-														 96.5.5: Meter started status flag
-														 D: types
-														 E: further processing or classification of quantities
-														 F: storage of data
-														 see DIN-EN-62056-61 */
-	char value[32+1];		/* value, i.e. the actual reading */
-	char unit[16+1];		/* the unit of the value, e.g. kWh, V, ... */
-
-	char baudrate;			/* 1 byte for */
-	char byte;			/* we parse our input byte wise */
-	int byte_iterator; 
-	size_t number_of_tuples;
-
-	byte_iterator =  number_of_tuples = baudrate = 0;
-
-	context = START;				/* start with context START */
-
-	while (::read(_fd, &byte, 1)) {
-		if (byte == '/') context = START; 	/* reset to START if "/" reoccurs */
-		else if (byte == '!') context = END;	/* "!" is the identifier for the END */
-		switch (context) {
+	do {
+		if (_pos >= _len) { /* refill buffer */
+			ssize_t bytes = ::read(_fd, _buffer, D0_BUFFER_LENGTH);
+
+			if (bytes < 0 && errno == EINTR) continue;
+			if (bytes <= 0) {
+				print(log_error, "read(): %s", name().c_str(), (bytes < 0) ? strerror(errno) : "end of file");
+				_context = START;
+				return 0;
+			}
+
+			_pos = 0;
+			_len = bytes;
+		}
+
+		_pos += _parse(_buffer + _pos, _len - _pos, rds, max_readings, &complete);
+	} while (!complete);
+
+	return _tuples;
+}
+
+ssize_t MeterD0::feed(const char *data, size_t len, std::vector<Reading> &rds, size_t n) {
+	bool complete = false;
+
+	if (!_pending.empty()) { /* continue behind the previous telegram */
+		_pending.insert(_pending.end(), data, data + len);
+		data = &_pending[0];
+		len = _pending.size();
+	}
+
+	size_t consumed = _parse(data, len, rds, n, &complete);
+
+	/* keep the remainder, readings of the next telegram would overwrite rds */
+	std::vector<char> rest(data + consumed, data + len);
+	_pending.swap(rest);
+
+	return (complete) ? _tuples : 0;
+}
+
+size_t MeterD0::_parse(const char *data, size_t len, std::vector<Reading> &rds, size_t max_readings, bool *complete) {
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		char byte = data[i]; /* we parse our input byte wise */
+
+		if (byte == '/') _context = START; 	/* reset to START if "/" reoccurs */
+		else if (byte == '!') _context = END;	/* "!" is the identifier for the END */
+		switch (_context) {
 				case START:			/* strip the initial "/" */
-                    if  (byte != '\r' &&  byte != '\n') { /*allow extra new line at the start */
-                      byte_iterator = number_of_tuples = 0;        /* start */
-                      context = VENDOR;        /* set new context: START -> VENDOR */
-                    }
+					if  (byte != '\r' &&  byte != '\n') { /*allow extra new line at the start */
+						_byte_iterator = _tuples = 0;        /* start */
+						_context = VENDOR;        /* set new context: START -> VENDOR */
+					}
 					break;
 
 				case VENDOR:			/* VENDOR has 3 Bytes */
 					if (!isalpha(byte)) goto error; /* Vendor ID needs to be alpha */
-					vendor[byte_iterator++] = byte;	/* read next byte */
-					if (byte_iterator >= 3) {	/* stop after 3rd byte */
-						vendor[byte_iterator] = '\0'; /* termination */
-						byte_iterator = 0;	/* reset byte counter */
+					_vendor[_byte_iterator++] = byte;	/* read next byte */
+					if (_byte_iterator >= 3) {	/* stop after 3rd byte */
+						_vendor[_byte_iterator] = '\0'; /* termination */
+						_byte_iterator = 0;	/* reset byte counter */
 
-						context = BAUDRATE;	/* set new context: VENDOR -> BAUDRATE */
-					} 
+						_context = BAUDRATE;	/* set new context: VENDOR -> BAUDRATE */
+					}
 					break;
 
 				case BAUDRATE:			/* BAUDRATE consists of 1 char only */
-					baudrate = byte;	
-					context = IDENTIFICATION;	/* set new context: BAUDRATE -> IDENTIFICATION */
-					byte_iterator = 0;
+					_baudrate_id = byte;
+					_context = IDENTIFICATION;	/* set new context: BAUDRATE -> IDENTIFICATION */
+					_byte_iterator = 0;
 					break;
 
 				case IDENTIFICATION:		/* IDENTIFICATION has 16 bytes */
 					if (byte == '\r' || byte == '\n') { /* detect line end */
-						identification[byte_iterator] = '\0'; /* termination */
-						context = OBIS_CODE;	/* set new context: IDENTIFICATION -> OBIS_CODE */
-						byte_iterator = 0;
+						_identification[_byte_iterator] = '\0'; /* termination */
+						_context = OBIS_CODE;	/* set new context: IDENTIFICATION -> OBIS_CODE */
+						_byte_iterator = 0;
+						_obis_code[0] = _value[0] = '\0';
+					}
+					else if (!isprint(byte)) {
+						print(log_error, "====> binary character '%x'", name().c_str(), byte);
 					}
 					else {
-						if(!isprint(byte)) {
-							print(log_error, "====> binary character '%x'", name().c_str(), byte);
-							//error_flag=true;
-						}
-						else {
-							identification[byte_iterator++] = byte;
-						}
+						if (_byte_iterator >= sizeof(_identification) - 1) goto error;
+						_identification[_byte_iterator++] = byte;
 					}
 					break;
 
 				case START_LINE:
 					break;
 				case OBIS_CODE:
-					if ((byte != '\n') && (byte != '\r')) 
+					if ((byte != '\n') && (byte != '\r'))
 					{
 						if (byte == '(') {
-							obis_code[byte_iterator] = '\0';
-							byte_iterator = 0;
+							_obis_code[_byte_iterator] = '\0';
+							_byte_iterator = 0;
 
-							context = VALUE;
+							_context = VALUE;
+						}
+						else {
+							if (_byte_iterator >= sizeof(_obis_code) - 1) goto error;
+							_obis_code[_byte_iterator++] = byte;
 						}
-						else obis_code[byte_iterator++] = byte;
 					}
 					break;
 
 				case VALUE:
 					if (byte == '*' || byte == ')') {
-						value[byte_iterator] = '\0';
-						byte_iterator = 0;
+						_value[_byte_iterator] = '\0';
+						_byte_iterator = 0;
 
 						if (byte == ')') {
-							unit[0] = '\0';
-							context =  END_LINE;
+							_unit[0] = '\0';
+							_context =  END_LINE;
 						}
 						else {
-							context = UNIT;
+							_context = UNIT;
 						}
 					}
-					else value[byte_iterator++] = byte;
+					else {
+						if (_byte_iterator >= sizeof(_value) - 1) goto error;
+						_value[_byte_iterator++] = byte;
+					}
 					break;
 
 				case UNIT:
 					if (byte == ')') {
-						unit[byte_iterator] = '\0';
-						byte_iterator = 0;
+						_unit[_byte_iterator] = '\0';
+						_byte_iterator = 0;
 
-						context = END_LINE;
+						_context = END_LINE;
+					}
+					else {
+						if (_byte_iterator >= sizeof(_unit) - 1) goto error;
+						_unit[_byte_iterator++] = byte;
 					}
-					else unit[byte_iterator++] = byte;
 					break;
 
 				case END_LINE:
 					if (byte == '\r' || byte == '\n') {
 						/* free slots available and sain content? */
-						if ((number_of_tuples < max_readings) && (strlen(obis_code) > 0) && 
-								(strlen(value) > 0)) {
-							print(log_debug, "Parsed reading (OBIS code=%s, value=%s, unit=%s)", name().c_str(), obis_code, value, unit);
-							rds[number_of_tuples].value(strtof(value, NULL));
-							Obis obis(obis_code);
-							ReadingIdentifier *rid(new ObisIdentifier(obis));
-							rds[number_of_tuples].identifier(rid);
-							rds[number_of_tuples].time();
-
-							byte_iterator = 0;
-							number_of_tuples++;
-
-							context = OBIS_CODE;
+						if ((_tuples < max_readings) && (strlen(_obis_code) > 0) &&
+								(strlen(_value) > 0)) {
+							print(log_debug, "Parsed reading (OBIS code=%s, value=%s, unit=%s)", name().c_str(), _obis_code, _value, _unit);
+							try {
+								Obis obis(_obis_code);
+								rds[_tuples].identifier(ObisIdentifier(obis));
+								rds[_tuples].value(strtof(_value, NULL));
+								rds[_tuples].time();
+								_tuples++;
+							} catch (vz::VZException &e) {
+								print(log_warning, "Skipping invalid OBIS code: %s", name().c_str(), _obis_code);
+							}
+
+							_byte_iterator = 0;
+							_context = OBIS_CODE;
 						}
 					}
 					break;
 
 				case END:
-					if(error_flag) {
-						print(log_error, "reading binary values.", name().c_str());
-						goto error;
-					}
 					print(log_debug, "Read package with %i tuples (vendor=%s, baudrate=%c, identification=%s)",
-								name().c_str(), number_of_tuples, vendor, baudrate, identification);
-					return number_of_tuples;
+								name().c_str(), _tuples, _vendor, _baudrate_id, _identification);
+					_context = START;
+					*complete = true;
+					return i + 1;
 		}
+		continue;
+
+		error:
+		print(log_error, "Something unexpected happened: %s:%i!", name().c_str(), __FUNCTION__, __LINE__);
+		_context = START; /* skip to the next telegram */
+		_tuples = 0;
 	}
 
-	error:
-	print(log_error, "Something unexpected happened: %s:%i!", name().c_str(), __FUNCTION__, __LINE__);
-	return 0;
+	return i;
 }
 
 int MeterD0::_openSocket(const char *node, const char *service) {
@@ -24,58 +24,309 @@
  */
 
 #include <stdlib.h>
-#include <sys/time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <algorithm>
 
 #include "protocols/MeterExec.hpp"
 #include "Options.hpp"
 #include <VZException.hpp>
 
+extern char **environ;
+
 MeterExec::MeterExec(std::list<Option> options) 
 		: Protocol("exec")
+		, _pid(-1)
+		, _exited(false)
+		, _signal(0)
+		, _fd(-1)
+		, _last(0)
+		, _next(0)
+		, _deadline(0)
 {
 	OptionList optlist;
 
 	try {
 		_command = optlist.lookup_string(options, "command");
 	} catch( vz::VZException &e ) {
-		print(log_error, "Missing command or invalid type", "");
+		print(log_error, "Missing command or invalid type", name().c_str());
 		throw;
 	}
 
+	/* a optional format string, default is a value per line */
 	try {
-		_format = optlist.lookup_string(options, "format");
+		_format = LineFormat(optlist.lookup_string(options, "format"));
 	} catch( vz::OptionNotFoundException &e ) {
-		_format = NULL; /* use default format */
+		/* use default format */
 	} catch( vz::VZException &e ) {
-		print(log_error, "Failed to parse format", "");
+		print(log_error, "Failed to parse format", name().c_str());
 		throw;
 	}
-}
 
-MeterExec::~MeterExec() {
+	/* keep the command running instead of starting it each interval */
+	try {
+		_persistent = optlist.lookup_bool(options, "persistent");
+	} catch( vz::OptionNotFoundException &e ) {
+		_persistent = false;
+	} catch( vz::VZException &e ) {
+		print(log_error, "Failed to parse 'persistent'", name().c_str());
+		throw;
+	}
+
+	try {
+		_timeout = optlist.lookup_int(options, "timeout");
+	} catch( vz::OptionNotFoundException &e ) {
+		_timeout = (_persistent) ? 0 : EXEC_DEFAULT_TIMEOUT; /* a persistent command may be silent */
+	} catch( vz::VZException &e ) {
+		print(log_error, "Failed to parse 'timeout'", name().c_str());
+		throw;
+	}
 
-	free((void*)_command);
+	try {
+		_interval = optlist.lookup_int(options, "interval");
+	} catch( vz::OptionNotFoundException &e ) {
+		_interval = -1;
+	} catch( vz::VZException &e ) {
+		print(log_error, "Failed to parse 'interval'", name().c_str());
+		throw;
+	}
 
-	if (_format != NULL) {
-		free((void*)_format);
+	if (!_persistent && _interval <= 0) {
+		print(log_warning, "No interval given, running command every %i seconds", name().c_str(), EXEC_DEFAULT_INTERVAL);
+		_interval = EXEC_DEFAULT_INTERVAL;
 	}
 }
 
+MeterExec::~MeterExec() {
+	close();
+}
+
 int MeterExec::open() {
+	if (access("/bin/sh", X_OK) < 0) {
+		print(log_error, "Cannot execute /bin/sh: %s", name().c_str(), strerror(errno));
+		return ERR;
+	}
+
+	/* a persistent command starts right away, single runs at the next multiple of the interval */
+	time_t now = time(NULL);
+	_next = (_persistent) ? now : (now / _interval + 1) * _interval;
 
-	// TODO implement
-	return ERR;
+	return SUCCESS;
 }
 
 int MeterExec::close() {
+	if (_fd >= 0) {
+		::close(_fd);
+		_fd = -1;
+	}
+
+	if (_pid > 0 && !_exited) { /* shutting down, no grace period */
+		kill(-_pid, SIGKILL);
+		waitpid(_pid, NULL, 0);
+	}
+
+	_pid = -1;
+	_exited = false;
+	_signal = 0;
+	_next = 0;
+	_deadline = 0;
+	_reader.clear();
 
-	// TODO implement
-	return ERR;
+	return SUCCESS;
 }
 
 ssize_t MeterExec::read(std::vector<Reading> &rds, size_t n) {
-	//meter_handle_exec_t *handle = &mtr->handle.exec;
+	return 0; /* driven by the MeterReactor */
+}
+
+ssize_t MeterExec::feed(const char *data, size_t len, std::vector<Reading> &rds, size_t n) {
+	size_t i = 0;
+	char *line;
+
+	if (len > 0) {
+		_reader.append(data, len);
+
+		if (_persistent && _timeout > 0 && _signal == 0) { /* silence is counted from the last output */
+			_deadline = time(NULL) + _timeout;
+		}
+	}
+
+	/* stop when full, the remaining lines are parsed with the next call */
+	while (i < n && (line = _reader.next()) != NULL) {
+		if (_format.parse(line, rds[i])) {
+			i++; /* read successfully */
+		}
+	}
+
+	return i;
+}
+
+ssize_t MeterExec::eof(std::vector<Reading> &rds, size_t n) {
+	size_t i = feed(NULL, 0, rds, n);
+	char *line;
+
+	if (i < n && (line = _reader.rest()) != NULL && _format.parse(line, rds[i])) {
+		i++; /* last line without terminator */
+	}
+
+	_reader.clear();
+	::close(_fd);
+	_fd = -1;
+
+	time_t now = time(NULL);
+	if (_exited || _reap()) {
+		_finish(now);
+	}
+	else if (_deadline == 0 || now + EXEC_KILL_GRACE < _deadline) {
+		_deadline = now + EXEC_KILL_GRACE; /* output is closed, the command should exit by now */
+	}
+
+	return i;
+}
+
+time_t MeterExec::deadline() const {
+	if (_deadline > 0 && (_next == 0 || _deadline < _next)) {
+		return _deadline;
+	}
+
+	return _next;
+}
+
+void MeterExec::timeout() {
+	time_t now = time(NULL);
+
+	if (_pid > 0 && _deadline > 0 && _deadline <= now) {
+		if (!_exited) {
+			_reap();
+		}
+
+		if (_exited && _fd < 0) {
+			_finish(now);
+		} else {
+			_kill(now);
+		}
+	}
+
+	if (_next > 0 && _next <= now) {
+		if (_pid > 0) {
+			print(log_warning, "Command is still running, skipping this run", name().c_str());
+		}
+		else if (_spawn() != SUCCESS && _persistent) {
+			_next = now + ((_interval > 0) ? _interval : 1); /* try again later */
+			return;
+		}
+
+		_next = (_persistent) ? 0 : (now / _interval + 1) * _interval;
+	}
+}
+
+int MeterExec::_spawn() {
+	posix_spawn_file_actions_t actions;
+	posix_spawnattr_t attr;
+	sigset_t mask;
+	int fds[2];
+
+	_last = time(NULL);
+
+	if (pipe2(fds, O_CLOEXEC) < 0) {
+		print(log_error, "pipe(): %s", name().c_str(), strerror(errno));
+		return ERR;
+	}
+
+	/* stdout to the pipe, stdin from /dev/null */
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+	posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+
+	/* own process group to kill the whole pipeline, default for the signals ignored by the daemon */
+	posix_spawnattr_init(&attr);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+	posix_spawnattr_setpgroup(&attr, 0);
+	sigemptyset(&mask);
+	posix_spawnattr_setsigmask(&attr, &mask);
+	sigaddset(&mask, SIGPIPE);
+	sigaddset(&mask, SIGCHLD);
+	sigaddset(&mask, SIGTSTP);
+	sigaddset(&mask, SIGTTOU);
+	sigaddset(&mask, SIGTTIN);
+	posix_spawnattr_setsigdefault(&attr, &mask);
+
+	char *argv[] = { (char *) "sh", (char *) "-c", (char *) _command.c_str(), NULL };
+	int ret = posix_spawn(&_pid, "/bin/sh", &actions, &attr, argv, environ);
+
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&actions);
+	::close(fds[1]);
+
+	if (ret != 0) {
+		print(log_error, "Cannot start command '%s': %s", name().c_str(), command(), strerror(ret));
+		::close(fds[0]);
+		_pid = -1;
+		return ERR;
+	}
+
+	print(log_debug, "Started command '%s' (pid=%i)", name().c_str(), command(), _pid);
+	_fd = fds[0];
+	_exited = false;
+	_signal = 0;
+	_deadline = (_timeout > 0) ? _last + _timeout : 0;
+	_reader.clear();
+
+	return SUCCESS;
+}
+
+bool MeterExec::_reap() {
+	int status;
+	pid_t ret = waitpid(_pid, &status, WNOHANG);
+
+	if (ret == 0) {
+		return false; /* still running */
+	}
+
+	if (ret > 0 && WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+		print(log_warning, "Command exited with status %i", name().c_str(), WEXITSTATUS(status));
+	}
+	else if (ret > 0 && WIFSIGNALED(status) && WTERMSIG(status) != _signal) {
+		print(log_warning, "Command killed by signal %i", name().c_str(), WTERMSIG(status));
+	}
+
+	_exited = true; /* or reaped already (ECHILD) */
+	return true;
+}
+
+void MeterExec::_kill(time_t now) {
+	if (_signal == 0) {
+		if (_fd >= 0 && _persistent) {
+			print(log_warning, "No output for %i seconds, restarting command", name().c_str(), _timeout);
+		}
+		else if (_fd >= 0) {
+			print(log_warning, "Command timed out after %i seconds", name().c_str(), _timeout);
+		}
+		_signal = SIGTERM;
+	}
+	else {
+		_signal = SIGKILL;
+	}
+
+	kill(-_pid, _signal); /* the whole process group */
+	_deadline = now + EXEC_KILL_GRACE;
+}
+
+void MeterExec::_finish(time_t now) {
+	if (_persistent) { /* don't restart a failing command in a tight loop */
+		_next = std::max(now, _last + ((_interval > 0) ? _interval : 1));
+
+		if (_signal == 0) {
+			print(log_warning, "Command terminated, restarting in %li seconds", name().c_str(), (long) (_next - now));
+		}
+	}
 
-	// TODO implement
-	return 0;
+	_pid = -1;
+	_exited = false;
+	_signal = 0;
+	_deadline = 0;
 }
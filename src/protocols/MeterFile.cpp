@@ -27,13 +27,26 @@
 #include <stdlib.h>
 #include <sys/time.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
 
 #include "protocols/MeterFile.hpp"
 #include "Options.hpp"
 #include <VZException.hpp>
 
+/* events of the opened file which wake up a blocked read() */
+#define FILE_WATCH_EVENTS (IN_MODIFY | IN_CLOSE_WRITE | IN_MOVE_SELF | IN_DELETE_SELF)
+
 MeterFile::MeterFile(std::list<Option> options)
 		: Protocol("file")
+		, _fd(-1)
+		, _changed(true)
+		, _inotify(-1)
+		, _watch_file(-1)
+		, _watch_dir(-1)
 {
 	OptionList optlist;
 
@@ -44,53 +57,14 @@ MeterFile::MeterFile(std::list<Option> options)
 		throw;
 	}
 
-	/* a optional format string for scanf() */
+	/* a optional format string, default is a value per line */
 	try {
 		const char *config_format = optlist.lookup_string(options, "format");
 
-		/**
-		 * Compiling the provided format string in a format string for scanf
-		 * by replacing the following tokens
-		 *
-		 * "$v" => "%1$f" (value)
-		 * "$i" => "%2$ms" (identifier)		(memory gets allocated by sscanf())
-		 * "$t" => "%3$f" (timestamp)
-		 */
-
-		int config_len = strlen(config_format);
-		int scanf_len = config_len + 8; /* adding extra space for longer conversion specification in scanf_format */
-
-		char *scanf_format = (char *)malloc(scanf_len); /* the scanf format string */
-
-		int i = 0; /* index in config_format string */
-		int j = 0; /* index in scanf_format string */
-		while (i <= config_len && j <= scanf_len) {
-			switch (config_format[i]) {
-					case '$':
-						if (i+1 < config_len) { /* introducing a token */
-							switch (config_format[i+1]) {
-									case 'v': j += sprintf(scanf_format+j, "%%1$f"); break;
-									case 'i': j += sprintf(scanf_format+j, "%%2$ms"); break;
-									case 't': j += sprintf(scanf_format+j, "%%3$lf"); break;
-							}
-							i++;
-						}
-						break;
-
-					case '%':
-						scanf_format[j++] = '%'; /* add double %% to escape a conversion identifier */
-
-					default:
-						scanf_format[j++] = config_format[i]; /* just copying */
-			}
-
-			i++;
-		}
-
-		print(log_debug, "Parsed format string \"%s\" => \"%s\"", name().c_str(), config_format, scanf_format);
-		_format = scanf_format;
+		_format = LineFormat(config_format);
+		print(log_debug, "Compiled format string \"%s\"", name().c_str(), format());
 	} catch( vz::OptionNotFoundException &e ) {
-		_format = ""; /* use default format */
+		/* use default format */
 	} catch( vz::VZException &e ) {
 		print(log_error, "Failed to parse format", name().c_str());
 		throw;
@@ -109,78 +83,197 @@ MeterFile::MeterFile(std::list<Option> options)
 		print(log_error, "Failed to parse 'rewind'", name().c_str());
 		throw;
 	}
+
+	/* files like /proc/loadavg don't notify changes, they are polled */
+	try {
+		_interval = optlist.lookup_int(options, "interval");
+	} catch( vz::OptionNotFoundException &e ) {
+		_interval = -1; /* wait for changes with inotify */
+	} catch( vz::VZException &e ) {
+		print(log_error, "Failed to parse 'interval'", name().c_str());
+		throw;
+	}
 }
 
 MeterFile::~MeterFile() {
 }
 
 int MeterFile::open() {
+	struct stat st;
 
-	_fd = fopen(path(), "r");
+	_fd = ::open(path(), O_RDONLY);
 
-	if (_fd == NULL) {
-		print(log_error, "fopen(%s): %s", name().c_str(), path(), strerror(errno));
+	if (_fd < 0) {
+		print(log_error, "open(%s): %s", name().c_str(), path(), strerror(errno));
 		return ERR;
 	}
+	_reader.clear();
+	_changed = true;
+
+	/* regular files are watched for changes, reading a fifo blocks anyway */
+	if (_interval < 0 && fstat(_fd, &st) == 0 && S_ISREG(st.st_mode)) {
+		_inotify = inotify_init1(IN_CLOEXEC);
+
+		if (_inotify < 0) {
+			print(log_warning, "inotify_init(): %s, polling file", name().c_str(), strerror(errno));
+		}
+		else {
+			size_t pos = _path.rfind('/');
+			std::string dir = (pos == std::string::npos) ? "." : _path.substr(0, (pos > 0) ? pos : 1);
+
+			_watch_file = inotify_add_watch(_inotify, path(), FILE_WATCH_EVENTS);
+			_watch_dir = inotify_add_watch(_inotify, dir.c_str(), IN_CREATE | IN_MOVED_TO);
+		}
+	}
 
 	return SUCCESS;
 }
 
 int MeterFile::close() {
+	if (_inotify >= 0) {
+		::close(_inotify);
+		_inotify = _watch_file = _watch_dir = -1;
+	}
 
-	return fclose(_fd);
+	return ::close(_fd);
 }
 
 ssize_t MeterFile::read(std::vector<Reading> &rds, size_t n) {
 	
-	// TODO use inotify to block eading until file changes
-
-	char line[256], *endptr;
-	char string[256];
+	char *line;
 	
-	/* reset file pointer to beginning of file */
+	/* read the whole file again as soon as it has been rewritten */
 	if (_rewind) {
-		rewind(_fd);
+		if (!_changed) {
+			_wait(IN_CLOSE_WRITE);
+		}
+		_changed = false;
+
+		if (_replaced()) { /* written to a temporary file and renamed */
+			_reopen();
+		}
+
+		lseek(_fd, 0, SEEK_SET);
+		_reader.clear();
 	}
 
 	unsigned int i = 0;
 	print(log_debug, "MeterFile::read: %d, %d", "", rds.size(), n);
 	
-	while (fgets(line, 256, _fd) && i < n) {
-		char *nl;
-		if ((nl = strrchr(line, '\n'))) *nl = '\0'; /* remove trailing newline */
-		if ((nl = strrchr(line, '\r'))) *nl = '\0';
+	while (i < n) {
+		if ((line = _reader.next()) == NULL) {
+			ssize_t bytes = _reader.fill(_fd);
+
+			if (bytes < 0) {
+				print(log_error, "read(%s): %s", name().c_str(), path(), strerror(errno));
+				break;
+			}
+			else if (bytes > 0) {
+				continue;
+			}
+
+			/* end of file */
+			if (_rewind) { /* a rewound file may lack the trailing newline */
+				if ((line = _reader.rest()) == NULL) {
+					break;
+				}
+			}
+			else if (i > 0) {
+				break; /* pass new readings before waiting for more */
+			}
+			else {
+				struct stat st;
 
-		if (_format != "") {
-			double timestamp;
+				if (_replaced() && _reopen() == SUCCESS) {
+					continue; /* rotated, the old file has been read completely */
+				}
 
-			/* at least the value has to been read */
-			double value;
-	
-			print(log_debug, "MeterFile::read: '%s'", "", line);
-			int found = sscanf(line, format(), &value, string, &timestamp);
-			print(log_debug, "MeterFile::read: %f, %s, %ld", "", value, string, timestamp);
-	
+				if (fstat(_fd, &st) == 0 && st.st_size < lseek(_fd, 0, SEEK_CUR)) {
+					print(log_info, "File has been truncated, reading from the beginning", name().c_str());
+					lseek(_fd, 0, SEEK_SET);
+					_reader.clear();
+					continue;
+				}
 
-			rds[i].value(value);
-			ReadingIdentifier *rid(new StringIdentifier(string));
-			rds[i].identifier(rid);
-			if (found >= 1) { // TODO free() space allocated for identifier string
-				rds[i].dtotv(timestamp); /* convert double to timeval */
-				i++; /* read successfully */
+				_wait(IN_MODIFY);
+				continue;
 			}
 		}
-		else { /* just reading a value per line */
-			rds[i].value(strtod(line, &endptr));
-			rds[i].time();
-			ReadingIdentifier* rid(new StringIdentifier(""));
-			rds[i].identifier(rid);
-
-			if (endptr != line) {
-				i++; /* read successfully */
-			}
+
+		if (_format.parse(line, rds[i])) {
+			i++; /* read successfully */
 		}
 	}
 
 	return i;
 }
+
+void MeterFile::_wait(uint32_t mask) {
+	char buf[sizeof(struct inotify_event) + NAME_MAX + 1]
+		__attribute__ ((aligned(__alignof__(struct inotify_event))));
+	std::string base = _path.substr(_path.rfind('/') + 1);
+	bool changed = false;
+
+	if (_inotify < 0) { /* polling */
+		sleep((_interval > 0) ? _interval : 1);
+		return;
+	}
+
+	while (!changed) {
+		ssize_t len = ::read(_inotify, buf, sizeof(buf));
+
+		if (len < 0) {
+			if (errno == EINTR) continue;
+
+			print(log_error, "read(inotify): %s", name().c_str(), strerror(errno));
+			sleep(1);
+			return;
+		}
+
+		for (char *p = buf; p < buf + len; ) {
+			struct inotify_event *ev = (struct inotify_event *) p;
+			p += sizeof(struct inotify_event) + ev->len;
+
+			if (ev->wd == _watch_file) {
+				if (ev->mask & (mask | IN_MOVE_SELF | IN_DELETE_SELF)) changed = true;
+				if (ev->mask & IN_IGNORED) _watch_file = -1; /* file has been removed */
+			}
+			else if (ev->wd == _watch_dir && ev->len > 0 && base == ev->name) {
+				changed = true; /* file has been (re)created */
+			}
+		}
+	}
+}
+
+bool MeterFile::_replaced() {
+	struct stat st, cur;
+
+	if (stat(path(), &st) < 0 || fstat(_fd, &cur) < 0) {
+		return false; /* not yet recreated */
+	}
+
+	return st.st_ino != cur.st_ino || st.st_dev != cur.st_dev;
+}
+
+int MeterFile::_reopen() {
+	int fd = ::open(path(), O_RDONLY);
+
+	if (fd < 0) {
+		print(log_error, "open(%s): %s", name().c_str(), path(), strerror(errno));
+		return ERR;
+	}
+
+	print(log_info, "File has been replaced, reopening %s", name().c_str(), path());
+	::close(_fd);
+	_fd = fd;
+	_reader.clear();
+
+	if (_inotify >= 0) {
+		if (_watch_file >= 0) {
+			inotify_rm_watch(_inotify, _watch_file);
+		}
+		_watch_file = inotify_add_watch(_inotify, path(), FILE_WATCH_EVENTS);
+	}
+
+	return SUCCESS;
+}
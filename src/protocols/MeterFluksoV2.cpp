@@ -27,6 +27,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "protocols/MeterFluksoV2.hpp"
@@ -76,67 +77,64 @@ int MeterFluksoV2::close() {
 
 ssize_t MeterFluksoV2::read(std::vector<Reading> &rds, size_t n) { 
 
-	size_t i = 0;		/* number of readings */
-	ssize_t bytes = 0;	/* read_line() return code */
-	char line[64];		/* stores each line read */
-	char *cursor = line;	/* moving cursor for strsep() */
+	char *line;
+
+	while ((line = _reader.next()) == NULL || *line == '\0') {
+		ssize_t bytes = _reader.fill(_fd); /* blocking read of the next chunk */
 
-	do {
-		bytes = _read_line(_fd, line, 64); /* blocking read of a complete line */
 		if (bytes < 0) {
-			print(log_error, "read_line(%s): %s", name().c_str(), _fifo, strerror(errno));
+			print(log_error, "read(%s): %s", name().c_str(), _fifo, strerror(errno));
 			return bytes; /* an error occured, pass through to caller */
 		}
-	} while (bytes == 0);
+		else if (bytes == 0) { /* no writer attached to the fifo */
+			return 0;
+		}
+	}
+
+	return _parse_line(line, rds, 0, n);
+}
+
+ssize_t MeterFluksoV2::feed(const char *data, size_t len, std::vector<Reading> &rds, size_t n) {
+	size_t i = 0;		/* number of readings */
+	char *line;
+
+	_reader.append(data, len);
+
+	/* one line per call, the remaining lines stay buffered until we are called again */
+	while (i == 0 && (line = _reader.next()) != NULL) {
+		if (*line != '\0') {
+			i = _parse_line(line, rds, 0, n);
+		}
+	}
+
+	return i;
+}
 
+size_t MeterFluksoV2::_parse_line(char *line, std::vector<Reading> &rds, size_t i, size_t n) {
+	char *cursor = line;	/* moving cursor for strsep() */
 
 	char *time_str = strsep(&cursor, " \t"); /* first token is the timestamp */
 	struct timeval time;
 	time.tv_sec = strtol(time_str, NULL, 10);
 	time.tv_usec = 0; /* no millisecond resolution available */
 
-	while (cursor) {
+	while (cursor && i + 2 <= n) {
 		int channel = atoi(strsep(&cursor, " \t")) + 1; /* increment by 1 to distinguish between +0 and -0 */
+		if (cursor == NULL) break; /* truncated line */
 
 		/* consumption - gets negative channel id as identifier! */
-		ReadingIdentifier *rid1(new ChannelIdentifier(-channel)); 
 		rds[i].time(time);
-		rds[i].identifier(rid1);
+		rds[i].identifier(ChannelIdentifier(-channel));
 		rds[i].value(atoi(strsep(&cursor, " \t")));
 		i++;
+		if (cursor == NULL) break;
 
 		/* power - gets positive channel id as identifier! */
-		ReadingIdentifier *rid2(new ChannelIdentifier(channel)); 
 		rds[i].time(time);
-		rds[i].identifier(rid2);
+		rds[i].identifier(ChannelIdentifier(channel));
 		rds[i].value(atoi(strsep(&cursor, " \t")));
 		i++;
 	}
 
 	return i;
 }
-
-
-ssize_t MeterFluksoV2::_read_line(int fd, char  *buffer, size_t n) {
-	size_t i = 0;	/* iterator for buffer */
-	char c;		/* character buffer */
-
-	while (i < n) {
-		ssize_t r = ::read(fd, &c, 1); /* read byte-per-byte, to identify a line break */
-
-		if (r == 1) { /* successful read */
-			switch (c) {
-					case '\n': /* line delimiter */
-						return i;
-
-					default: /* normal character */
-						buffer[i++] = c;
-			}
-		}
-		else if (r < 0) { /* an error occured, pass through to caller */
-			return r;
-		}
-	}
-
-	return i;
-}
@@ -26,27 +26,131 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
+#include <poll.h>
+#include <time.h>
 #include <sys/time.h>
+#include <sys/ioctl.h>
+#include <sys/eventfd.h>
+#include <linux/serial.h>
 #include <errno.h>
+#include <algorithm>
+#include <sstream>
 
 #include "protocols/MeterS0.hpp"
 #include "Options.hpp"
 #include <VZException.hpp>
 
+static const struct {
+	const char *name;
+	int bit;
+} s0_lines[] = {
+	{ "cts", TIOCM_CTS },
+	{ "dsr", TIOCM_DSR },
+	{ "dcd", TIOCM_CD },
+	{ "ri", TIOCM_RI },
+	{ NULL, 0 }
+};
+
+static uint64_t monotonic() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int gpio_write(const char *path, const char *value) {
+	int fd = ::open(path, O_WRONLY);
+
+	if (fd < 0) {
+		return ERR;
+	}
+
+	ssize_t ret = ::write(fd, value, strlen(value));
+	::close(fd);
+
+	return (ret < 0) ? ERR : SUCCESS;
+}
+
+/**
+ * Transitions of a modem status line counted by the uart
+ */
+static uint32_t line_edges(const struct serial_icounter_struct &icount, int bit) {
+	switch (bit) {
+			case TIOCM_CTS: return icount.cts;
+			case TIOCM_DSR: return icount.dsr;
+			case TIOCM_CD:  return icount.dcd;
+			default:        return icount.rng;
+	}
+}
+
 MeterS0::MeterS0(std::list<Option> options)
 		: Protocol("s0")
-		, _counter(0)
+		, _mode(capture_rx)
+		, _icount(false)
+		, _fd(-1)
+		, _thread_running(false)
+		, _head(0)
+		, _tail(0)
+		, _overflows(0)
+		, _overflows_seen(0)
 {
 	OptionList optlist;
+	std::vector<int> sources;
 
+	/* a single gpio or a comma separated list */
 	try {
-		_device = optlist.lookup_string(options, "device");
+		sources.push_back(optlist.lookup_int(options, "gpio"));
+		_mode = capture_gpio;
+	} catch( vz::OptionNotFoundException &e ) {
+		/* use tty */
+	} catch( vz::InvalidTypeException &e ) {
+		std::istringstream gpios(optlist.lookup_string(options, "gpio"));
+		std::string gpio;
+		while (std::getline(gpios, gpio, ',')) {
+			sources.push_back(atoi(gpio.c_str()));
+		}
+		_mode = capture_gpio;
 	} catch( vz::VZException &e ) {
-		print(log_error, "Missing device or invalid type", "");
+		print(log_error, "Failed to parse gpio", "");
 		throw;
 	}
 
+	if (_mode != capture_gpio) {
+		try {
+			_device = optlist.lookup_string(options, "device");
+		} catch( vz::VZException &e ) {
+			print(log_error, "Missing device or invalid type", "");
+			throw;
+		}
+
+		/* modem status lines as inputs, e.g. "cts,dcd" */
+		try {
+			std::istringstream lines(optlist.lookup_string(options, "lines"));
+			std::string line;
+			while (std::getline(lines, line, ',')) {
+				size_t i;
+				for (i = 0; s0_lines[i].name && line != s0_lines[i].name; i++);
+				if (s0_lines[i].name == NULL) {
+					print(log_error, "Unknown modem status line '%s'", "", line.c_str());
+					throw vz::VZException("Invalid lines.");
+				}
+				sources.push_back(s0_lines[i].bit);
+			}
+			_mode = capture_lines;
+		} catch( vz::OptionNotFoundException &e ) {
+			sources.push_back(0); /* rx */
+		} catch( vz::VZException &e ) {
+			print(log_error, "Failed to parse lines", "");
+			throw;
+		}
+	}
+
+	if (sources.empty() || sources.size() > S0_MAX_INPUTS) {
+		throw vz::VZException("Invalid number of S0 inputs.");
+	}
+
 	try {
 		_resolution = optlist.lookup_int(options, "resolution");
 	} catch( vz::OptionNotFoundException &e ) {
@@ -56,30 +160,152 @@ MeterS0::MeterS0(std::list<Option> options)
 		throw;
 	}
 	if(_resolution < 1) throw vz::VZException("Resolution must be greater than 0.");
+
+	int debounce;
+	try {
+		debounce = optlist.lookup_int(options, "debounce");
+	} catch( vz::OptionNotFoundException &e ) {
+		debounce = S0_DEFAULT_DEBOUNCE;
+	} catch( vz::VZException &e ) {
+		print(log_error, "Failed to parse debounce", "");
+		throw;
+	}
+	if(debounce < 0) throw vz::VZException("Debounce must not be negative.");
+	_debounce = debounce * 1000000ULL;
+
+	int window;
+	try {
+		window = optlist.lookup_int(options, "window");
+	} catch( vz::OptionNotFoundException &e ) {
+		window = S0_DEFAULT_WINDOW;
+	} catch( vz::VZException &e ) {
+		print(log_error, "Failed to parse window", "");
+		throw;
+	}
+	if(window < 1) throw vz::VZException("Window must be greater than 0.");
+	_window = window;
+
+	for (size_t i = 0; i < sources.size(); i++) {
+		input_t input;
+
+		input.source = sources[i];
+		input.fd = -1;
+		input.edges = 0;
+		input.level = false;
+		input.counter = 0;
+		input.last = 0;
+		input.accepted = 0;
+		input.pulsed = false;
+		input.pulses.resize(_window + 1);
+
+		_inputs.push_back(input);
+	}
+
+	/* created here, the descriptor has to be known before the meter is opened */
+	_event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (_event < 0) {
+		throw vz::VZException("Cannot create eventfd.");
+	}
 }
 
 MeterS0::~MeterS0() {
-	//free((void*)_device);
+	::close(_event);
 }
 
 int MeterS0::open() {
+	if (_open_inputs() != SUCCESS) {
+		return ERR;
+	}
+
+	if (pthread_create(&_thread, NULL, &_capture_thread, (void *) this) != 0) {
+		print(log_error, "Cannot start capture thread", name().c_str());
+		_close_inputs();
+		return ERR;
+	}
+	_thread_running = true;
+
+	return SUCCESS;
+}
+
+int MeterS0::close() {
+	if (_thread_running) {
+		pthread_cancel(_thread);
+		pthread_join(_thread, NULL);
+		_thread_running = false;
+	}
+
+	_close_inputs();
+
+	return SUCCESS;
+}
+
+int MeterS0::_open_inputs() {
+	if (_mode == capture_gpio) {
+		for (size_t i = 0; i < _inputs.size(); i++) {
+			_inputs[i].fd = _open_gpio(_inputs[i].source);
+			if (_inputs[i].fd < 0) {
+				_close_inputs();
+				return ERR;
+			}
+		}
+		return SUCCESS;
+	}
 
-	/* open port */
-	int fd = ::open(_device, O_RDWR | O_NOCTTY); 
+	_fd = _open_device(&_old_tio, B300);
+	if (_fd < 0) {
+		return ERR;
+	}
+
+	if (_mode == capture_lines) { /* current levels and transition counters */
+		struct serial_icounter_struct icount;
+		int status = 0;
+
+		ioctl(_fd, TIOCMGET, &status);
+		_icount = (ioctl(_fd, TIOCGICOUNT, &icount) == 0);
+		if (!_icount) {
+			print(log_warning, "Transitions are not counted by %s, short pulses may be missed", name().c_str(), _device.c_str());
+		}
+
+		for (size_t i = 0; i < _inputs.size(); i++) {
+			_inputs[i].level = (status & _inputs[i].source) != 0;
+			_inputs[i].edges = (_icount) ? line_edges(icount, _inputs[i].source) : 0;
+		}
+	}
+
+	return SUCCESS;
+}
+
+void MeterS0::_close_inputs() {
+	for (size_t i = 0; i < _inputs.size(); i++) {
+		if (_inputs[i].fd >= 0) {
+			::close(_inputs[i].fd);
+			_inputs[i].fd = -1;
+		}
+	}
+
+	if (_fd >= 0) {
+		tcsetattr(_fd, TCSANOW, &_old_tio); /* reset serial port */
+		::close(_fd);
+		_fd = -1;
+	}
+}
+
+int MeterS0::_open_device(struct termios *old_tio, speed_t baudrate) {
+	int fd = ::open(_device.c_str(), O_RDWR | O_NOCTTY);
 
 	if (fd < 0) {
-		print(log_error, "open(%s): %s", "", _device, strerror(errno));
+		print(log_error, "open(%s): %s", name().c_str(), _device.c_str(), strerror(errno));
 		return ERR;
 	}
 
 	/* save current port settings */
-	tcgetattr(fd, &_old_tio);
+	tcgetattr(fd, old_tio);
 
 	/* configure port */
 	struct termios tio;
 	memset(&tio, 0, sizeof(struct termios));
 
-	tio.c_cflag = B300 | CS8 | CLOCAL | CREAD;
+	tio.c_cflag = baudrate | CS8 | CLOCAL | CREAD;
 	tio.c_iflag = IGNPAR;
 	tio.c_oflag = 0;
 	tio.c_lflag = 0;
@@ -90,55 +316,293 @@ int MeterS0::open() {
 
 	/* apply configuration */
 	tcsetattr(fd, TCSANOW, &tio);
-	_fd = fd;
 
-	return SUCCESS;
+	return fd;
 }
 
-int MeterS0::close() {
+int MeterS0::_open_gpio(int gpio) {
+	char path[64], value[16];
 
-	tcsetattr(_fd, TCSANOW, &_old_tio); /* reset serial port */
+	snprintf(path, sizeof(path), "/sys/class/gpio/gpio%d/value", gpio);
+	if (access(path, F_OK) < 0) {
+		snprintf(value, sizeof(value), "%d", gpio);
+		gpio_write("/sys/class/gpio/export", value);
+	}
+
+	/* interrupt on rising edges */
+	snprintf(path, sizeof(path), "/sys/class/gpio/gpio%d/direction", gpio);
+	gpio_write(path, "in");
+	snprintf(path, sizeof(path), "/sys/class/gpio/gpio%d/edge", gpio);
+	if (gpio_write(path, "rising") < 0) {
+		print(log_error, "Cannot enable interrupts of gpio%d: %s", name().c_str(), gpio, strerror(errno));
+		return ERR;
+	}
 
-	return ::close(_fd); /* close serial port */
+	snprintf(path, sizeof(path), "/sys/class/gpio/gpio%d/value", gpio);
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0) {
+		print(log_error, "open(%s): %s", name().c_str(), path, strerror(errno));
+		return ERR;
+	}
+
+	/* reading the value clears a pending interrupt */
+	if (::read(fd, value, sizeof(value)) < 0) {}
+
+	return fd;
 }
 
-ssize_t MeterS0::read(std::vector<Reading> &rds, size_t n) {
+void * MeterS0::_capture_thread(void *arg) {
+	MeterS0 *meter = static_cast<MeterS0 *>(arg);
+
+	meter->_capture();
+
+	pthread_exit(0);
+	return NULL;
+}
+
+void MeterS0::_capture() {
+	bool opened = true;
 
-	struct timeval time1;
-	struct timeval time2;
-	char buf[8];
-
-	/* clear input buffer */
-	tcflush(_fd, TCIOFLUSH);
-
-	/* blocking until one character/pulse is read */
-	if( ::read(_fd, buf, 8) < 1) return 0;
-	gettimeofday(&time1, NULL);
-	if( ::read(_fd, buf, 8) < 1) return 0;
-	gettimeofday(&time2, NULL);
-
-	double t1 = time1.tv_sec + time1.tv_usec / 1e6;
-	double t2 = time2.tv_sec + time2.tv_usec / 1e6;
-	double value = ( 3600000 ) / ( (t2-t1) * _resolution ) ;
-	
-	/* store current timestamp */
-	ReadingIdentifier *rid(new NilIdentifier());
-	rds[0].identifier(new StringIdentifier("Counter"));
-	rds[0].time(time2);
-	rds[0].value(++_counter);
-
-	rds[1].identifier(rid);
-	rds[1].time(time2);
-	rds[1].value(1);
-
-	rds[2].identifier(new StringIdentifier("Power"));
-	rds[2].time(time2);
-	rds[2].value(value);
-
-	print(log_debug, "Reading S0 - n=%d power=%f  counter=%f", name().c_str(), n, value, rds[2].value());
-	/* wait some ms for debouncing */
-	usleep(30000);
+	for (;;) {
+		int ret;
+
+		if (!opened) { /* try to recover the inputs */
+			sleep(1);
+			opened = (_open_inputs() == SUCCESS);
+			continue;
+		}
+
+		switch (_mode) {
+				case capture_lines: ret = _capture_lines(); break;
+				case capture_gpio:  ret = _capture_gpio(); break;
+				default:            ret = _capture_rx(); break;
+		}
+
+		if (ret < 0 && errno == EINTR) {
+			continue;
+		}
+		else if (ret <= 0) {
+			print(log_error, "Lost pulse input: %s", name().c_str(), (ret < 0) ? strerror(errno) : "EOF");
+			_close_inputs();
+			opened = false;
+		}
+	}
+}
+
+int MeterS0::_capture_rx() {
+	char buf[64];
+
+	/* blocks until at least one character/pulse is received */
+	ssize_t bytes = ::read(_fd, buf, sizeof(buf));
+	uint64_t now = monotonic();
+
+	for (ssize_t i = 0; i < bytes; i++) {
+		_push(now, 0); /* bounces are dropped by the consumer */
+	}
+
+	return bytes;
+}
+
+int MeterS0::_capture_lines() {
+	struct serial_icounter_struct icount;
+	int mask = 0, status = 0, ret, type;
+
+	for (size_t i = 0; i < _inputs.size(); i++) {
+		mask |= _inputs[i].source;
+	}
+
+	/* ioctl() is no cancellation point, but nothing is held while waiting */
+	pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, &type);
+	ret = ioctl(_fd, TIOCMIWAIT, mask);
+	pthread_setcanceltype(type, NULL);
+
+	uint64_t now = monotonic();
+
+	if (ret < 0) {
+		return ret;
+	}
+	else if (_icount) {
+		ret = ioctl(_fd, TIOCGICOUNT, &icount);
+	}
+	else {
+		ret = ioctl(_fd, TIOCMGET, &status);
+	}
+
+	if (ret < 0) {
+		return ret;
+	}
+
+	for (size_t i = 0; i < _inputs.size(); i++) {
+		input_t &input = _inputs[i];
+		uint32_t pulses;
+
+		if (_icount) { /* also catches pulses shorter than our wakeup */
+			uint32_t edges = line_edges(icount, input.source) - input.edges;
+			input.edges += edges;
+
+			if (input.source == TIOCM_RI) {
+				pulses = edges; /* only trailing edges are counted */
+			}
+			else { /* rising edges */
+				pulses = (edges + !input.level) / 2;
+				input.level ^= edges & 1;
+			}
+		}
+		else {
+			bool level = (status & input.source) != 0;
+			pulses = (level && !input.level) ? 1 : 0;
+			input.level = level;
+		}
+
+		if (_icount && pulses > 0) {
+			_push(now, i, pulses); /* hardware counted, no bounces */
+		}
+		else if (pulses > 0) {
+			_push(now, i);
+		}
+	}
 
 	return 1;
 }
 
+int MeterS0::_capture_gpio() {
+	struct pollfd pfds[S0_MAX_INPUTS];
+	char buf[16];
+
+	for (size_t i = 0; i < _inputs.size(); i++) {
+		pfds[i].fd = _inputs[i].fd;
+		pfds[i].events = POLLPRI | POLLERR;
+		pfds[i].revents = 0;
+	}
+
+	int ret = poll(pfds, _inputs.size(), -1);
+	uint64_t now = monotonic();
+
+	for (size_t i = 0; i < _inputs.size() && ret > 0; i++) {
+		if (pfds[i].revents) {
+			lseek(pfds[i].fd, 0, SEEK_SET);
+			if (::read(pfds[i].fd, buf, sizeof(buf)) < 0) {
+				return -1;
+			}
+			_push(now, i);
+		}
+	}
+
+	return (ret < 0) ? ret : 1;
+}
+
+void MeterS0::_push(uint64_t ns, size_t input, uint32_t count) {
+	size_t head = _head;
+
+	if (head - _tail >= S0_QUEUE_LENGTH) {
+		_overflows++;
+		return;
+	}
+
+	pulse_t &pulse = _queue[head & (S0_QUEUE_LENGTH - 1)];
+	pulse.ns = ns;
+	pulse.input = input;
+	pulse.count = count;
+	__sync_synchronize(); /* pulse has to be stored before it is published */
+	_head = head + 1;
+
+	uint64_t one = 1;
+	if (::write(_event, &one, sizeof(one)) < 0) {} /* counter saturated, consumer is awake anyway */
+}
+
+size_t MeterS0::_drain(std::vector<Reading> &rds, size_t n) {
+	size_t head = _head;
+
+	__sync_synchronize(); /* pulses published up to head are complete */
+
+	for (size_t tail = _tail; tail != head; tail++) {
+		const pulse_t &pulse = _queue[tail & (S0_QUEUE_LENGTH - 1)];
+		input_t &input = _inputs[pulse.input];
+
+		if (pulse.count == 0 && input.accepted > 0 && pulse.ns - input.last < _debounce) {
+			continue; /* bounce */
+		}
+
+		for (uint32_t k = 0; k < std::max(pulse.count, (uint32_t) 1); k++) {
+			input.pulses[input.accepted % input.pulses.size()] = pulse.ns;
+			input.accepted++;
+			input.counter++;
+		}
+		input.last = pulse.ns;
+		input.pulsed = true;
+	}
+
+	__sync_synchronize(); /* slots have to be read before they are released */
+	_tail = head;
+
+	if (_overflows != _overflows_seen) {
+		print(log_warning, "Pulse queue overflow, lost %lu pulses", name().c_str(), _overflows - _overflows_seen);
+		_overflows_seen = _overflows;
+	}
+
+	/* offset of the wall clock to the monotonic clock */
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	int64_t offset = tv.tv_sec * 1000000LL + tv.tv_usec - monotonic() / 1000;
+
+	size_t i = 0;
+	for (size_t in = 0; in < _inputs.size() && i + 2 <= n; in++) {
+		input_t &input = _inputs[in];
+		int channel = in + 1; /* increment by 1 to distinguish between +0 and -0 */
+
+		if (!input.pulsed) {
+			continue;
+		}
+		input.pulsed = false;
+
+		/* timestamp of the last pulse */
+		int64_t usec = input.last / 1000 + offset;
+		tv.tv_sec = usec / 1000000;
+		tv.tv_usec = usec % 1000000;
+
+		/* number of pulses - gets negative channel id as identifier! */
+		rds[i].identifier(ChannelIdentifier(-channel));
+		rds[i].time(tv);
+		rds[i].value(input.counter, 0);
+		i++;
+
+		/* power over the last pulse intervals - gets positive channel id as identifier! */
+		size_t k = std::min(input.accepted - 1, _window);
+		uint64_t first = input.pulses[(input.accepted - 1 - k) % input.pulses.size()];
+
+		if (k > 0 && input.last > first) {
+			double value = 3600000.0 * k / ((input.last - first) / 1e9 * _resolution);
+
+			rds[i].identifier(ChannelIdentifier(channel));
+			rds[i].time(tv);
+			rds[i].value(value);
+			i++;
+
+			print(log_debug, "Reading S0 - input=%d counter=%lld power=%f", name().c_str(),
+						in, (long long) input.counter, value);
+		}
+	}
+
+	return i;
+}
+
+ssize_t MeterS0::feed(const char *data, size_t len, std::vector<Reading> &rds, size_t n) {
+	/* data is the eventfd counter, the pulses are taken from the queue */
+	return _drain(rds, n);
+}
+
+ssize_t MeterS0::read(std::vector<Reading> &rds, size_t n) {
+	for (;;) {
+		size_t i = _drain(rds, n);
+		if (i > 0) {
+			return i;
+		}
+
+		/* wait for the capture thread */
+		struct pollfd pfd = { _event, POLLIN, 0 };
+		if (poll(&pfd, 1, -1) > 0) {
+			uint64_t count;
+			if (::read(_event, &count, sizeof(count)) < 0) {}
+		}
+	}
+}
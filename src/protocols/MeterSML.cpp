@@ -33,10 +33,12 @@
 #include <errno.h>
 #include <string.h>
 #include <math.h>
+#include <algorithm>
 #include <sys/time.h>
 
 /* serial port */
 #include <fcntl.h>
+#include <poll.h>
 #include <sys/ioctl.h>
 
 /* socket */
@@ -45,20 +47,247 @@
 
 /* sml stuff */
 #include <sml/sml_file.h>
-#include <sml/sml_transport.h>
 
 #include "protocols/MeterSML.hpp"
 #include "Obis.hpp"
 #include "Options.hpp"
 #include <VZException.hpp>
 
-#define SML_BUFFER_LEN 8096
+#define SML_BUFFER_LEN 8192
+#define SML_NO_FRAME ((size_t) -1)
+
+static const unsigned char sml_escape[4] = { 0x1b, 0x1b, 0x1b, 0x1b };
+static const unsigned char sml_start[4] = { 0x01, 0x01, 0x01, 0x01 };
+
+/* type-length field of the SML binary encoding */
+#define TLV_MORE 0x80
+#define TLV_TYPE 0x70
+#define TLV_LEN 0x0f
+
+#define TLV_OCTET 0x00
+#define TLV_BOOL 0x40
+#define TLV_INT 0x50
+#define TLV_UINT 0x60
+#define TLV_LIST 0x70
+
+#define TLV_TIME_SEC_INDEX 0x01   /* seconds since an arbitrary point, not a time */
+
+/* cursor of the native decoder, errors are sticky */
+typedef struct {
+	const unsigned char *p;
+	const unsigned char *end;
+	bool error;
+} tlv_cursor_t;
+
+/**
+ * Read a type-length field
+ *
+ * @param len number of elements for lists, payload length otherwise
+ * @return type or -1 on error
+ */
+static int tlv_read(tlv_cursor_t *c, size_t *len) {
+	size_t tl = 1;
+
+	if (c->error || c->p >= c->end) {
+		c->error = true;
+		return -1;
+	}
+
+	unsigned char b = c->p[0];
+	int type = b & TLV_TYPE;
+	size_t l = b & TLV_LEN;
+
+	while (b & TLV_MORE) {
+		if (c->p + tl >= c->end) {
+			c->error = true;
+			return -1;
+		}
+		b = c->p[tl++];
+		l = (l << 4) | (b & TLV_LEN);
+	}
+	c->p += tl;
+
+	if (type != TLV_LIST) { /* length includes the type-length field */
+		if (l < tl || c->p + (l - tl) > c->end) {
+			c->error = true;
+			return -1;
+		}
+		l -= tl;
+	}
+
+	*len = l;
+	return type;
+}
+
+static void tlv_skip(tlv_cursor_t *c) {
+	size_t len;
+	int type = tlv_read(c, &len);
+
+	if (type == TLV_LIST) {
+		for (size_t i = 0; i < len && !c->error; i++) {
+			tlv_skip(c);
+		}
+	}
+	else if (type >= 0) {
+		c->p += len;
+	}
+}
+
+/**
+ * Read an optional octet string
+ *
+ * @return false if the field is not set
+ */
+static bool tlv_octet(tlv_cursor_t *c, const unsigned char **str, size_t *len) {
+	if (tlv_read(c, len) != TLV_OCTET) {
+		c->error = true;
+		return false;
+	}
+
+	*str = c->p;
+	c->p += *len;
+	return *len > 0;
+}
+
+/**
+ * Read an optional integer (bool, int or uint)
+ *
+ * @return false if the field is not set
+ */
+static bool tlv_number(tlv_cursor_t *c, double *value, int64_t *integer = NULL) {
+	size_t len;
+	int type = tlv_read(c, &len);
+
+	if (type == TLV_OCTET) { /* not set (0x01) or an octet string value */
+		c->p += len;
+		return false;
+	}
+	else if (type != TLV_BOOL && type != TLV_INT && type != TLV_UINT) {
+		c->error = true;
+		return false;
+	}
+	else if (len == 0 || len > 8) {
+		c->error = true;
+		return false;
+	}
+
+	uint64_t u = 0;
+	for (size_t i = 0; i < len; i++) {
+		u = (u << 8) | c->p[i];
+	}
+	c->p += len;
+
+	if (type == TLV_INT) { /* sign extension */
+		int64_t v = (len < 8 && (u >> (len * 8 - 1)) & 1) ? (int64_t) (u | (~0ULL << (len * 8))) : (int64_t) u;
+		*value = v;
+		if (integer) *integer = v;
+	}
+	else {
+		*value = u;
+		if (integer) *integer = (int64_t) u;
+	}
+
+	return true;
+}
+
+/**
+ * Exact integer of a libsml value
+ *
+ * @return false for octet strings and unsigned values above INT64_MAX
+ */
+static bool sml_value_to_int64(sml_value *value, int64_t *v) {
+	switch (value->type & SML_TYPE_FIELD) {
+			case SML_TYPE_BOOLEAN:
+				*v = *value->data.boolean ? 1 : 0;
+				return true;
+
+			case SML_TYPE_INTEGER:
+				switch (value->type & SML_LENGTH_FIELD) {
+						case SML_TYPE_NUMBER_8:  *v = *value->data.int8; return true;
+						case SML_TYPE_NUMBER_16: *v = *value->data.int16; return true;
+						case SML_TYPE_NUMBER_32: *v = *value->data.int32; return true;
+						case SML_TYPE_NUMBER_64: *v = *value->data.int64; return true;
+				}
+				return false;
+
+			case SML_TYPE_UNSIGNED:
+				switch (value->type & SML_LENGTH_FIELD) {
+						case SML_TYPE_NUMBER_8:  *v = *value->data.uint8; return true;
+						case SML_TYPE_NUMBER_16: *v = *value->data.uint16; return true;
+						case SML_TYPE_NUMBER_32: *v = *value->data.uint32; return true;
+						case SML_TYPE_NUMBER_64:
+							*v = (int64_t) *value->data.uint64;
+							return *v >= 0;
+				}
+				return false;
+
+			default:
+				return false;
+	}
+}
+
+/**
+ * CRC-16/X-25 as used by SML messages and transport
+ */
+static uint16_t crc16_x25(const unsigned char *data, size_t len) {
+	uint16_t crc = 0xffff;
+
+	for (size_t i = 0; i < len; i++) {
+		crc ^= data[i];
+		for (int k = 0; k < 8; k++) {
+			crc = (crc & 1) ? (crc >> 1) ^ 0x8408 : (crc >> 1);
+		}
+	}
+
+	return crc ^ 0xffff;
+}
+
+/**
+ * Read an optional SML_Time
+ *
+ * @return false if the field is not set or not a point in time
+ */
+static bool tlv_time(tlv_cursor_t *c, time_t *time) {
+	size_t len;
+	double choice, value;
+
+	if (c->p < c->end && *c->p == 0x01) { /* not set */
+		c->p++;
+		return false;
+	}
+
+	if (tlv_read(c, &len) != TLV_LIST || len != 2 || !tlv_number(c, &choice)) {
+		c->error = true;
+		return false;
+	}
+
+	if (c->p < c->end && (*c->p & TLV_TYPE) == TLV_LIST) { /* local timestamp */
+		if (tlv_read(c, &len) != TLV_LIST || len < 1 || !tlv_number(c, &value)) {
+			c->error = true;
+			return false;
+		}
+		for (size_t i = 1; i < len; i++) tlv_skip(c); /* offsets */
+	}
+	else if (!tlv_number(c, &value)) {
+		c->error = true;
+		return false;
+	}
+
+	*time = (time_t) value;
+	return !c->error && choice != TLV_TIME_SEC_INDEX;
+}
 
 MeterSML::MeterSML(std::list<Option> options) 
 		: Protocol("sml")
 		, _host("")
 		, _device("")
 		, BUFFER_LEN(SML_BUFFER_LEN)
+		, _buffer(SML_BUFFER_LEN)
+		, _begin(0)
+		, _start(SML_NO_FRAME)
+		, _scan(0)
+		, _out(0)
+		, _end(0)
 {
 	OptionList optlist;
 
@@ -99,7 +328,7 @@ MeterSML::MeterSML(std::list<Option> options)
 		}
 	} catch( vz::OptionNotFoundException &e ) {
 		/* using default value if not specified */
-		_baudrate = 9600;
+		_baudrate = B9600;
 	} catch( vz::VZException &e ) {
 		print(log_error, "Failed to parse the baudrate", name().c_str());
 		throw;
@@ -108,7 +337,16 @@ MeterSML::MeterSML(std::list<Option> options)
 
 MeterSML::MeterSML(const MeterSML &proto)
 		: Protocol(proto)
+		, _host(proto._host)
+		, _device(proto._device)
+		, _baudrate(proto._baudrate)
 		, BUFFER_LEN(SML_BUFFER_LEN)
+		, _buffer(SML_BUFFER_LEN)
+		, _begin(0)
+		, _start(SML_NO_FRAME)
+		, _scan(0)
+		, _out(0)
+		, _end(0)
 {
 }
 
@@ -142,32 +380,176 @@ int MeterSML::close() {
 }
 
 ssize_t MeterSML::read(std::vector<Reading> &rds, size_t n) {
+	unsigned char *payload;
+	size_t len;
+
+	/* wait until a we receive a new datagram from the meter */
+	while (!_frame(&payload, &len)) {
+		ssize_t bytes = ::read(_fd, &_buffer[_end], _compact());
+
+		if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			struct pollfd pfd = { _fd, POLLIN, 0 };
+			poll(&pfd, 1, -1); /* port has been opened non-blocking */
+			continue;
+		}
+		else if (bytes < 0 && errno == EINTR) {
+			continue;
+		}
+		else if (bytes <= 0) {
+			print(log_error, "read(): %s", name().c_str(), (bytes < 0) ? strerror(errno) : "end of file");
+			return 0;
+		}
+
+		_end += bytes;
+	}
 
-	unsigned char buffer[SML_BUFFER_LEN];
-	size_t bytes, m = 0;
+	return _parse_file(payload, len, rds, n);
+}
+
+ssize_t MeterSML::feed(const char *data, size_t len, std::vector<Reading> &rds, size_t n) {
+	unsigned char *payload;
+	size_t payload_len;
 
-	sml_file *file;
-	sml_get_list_response *body;
-	sml_list *entry;
+	if (len > 0) {
+		if (_compact() < len) {
+			print(log_warning, "Receive buffer overflow, dropping data", name().c_str());
+			_begin = _end = 0;
+			_start = SML_NO_FRAME;
+			len = std::min(len, _buffer.size());
+		}
 
-	/* wait until a we receive a new datagram from the meter (blocking read) */
-	bytes = sml_transport_read(_fd, buffer, SML_BUFFER_LEN);
+		memcpy(&_buffer[_end], data, len);
+		_end += len;
+	}
+
+	/* one datagram per call, the caller continues with an empty chunk */
+	if (_frame(&payload, &payload_len)) {
+		return _parse_file(payload, payload_len, rds, n);
+	}
+
+	return 0;
+}
 
-	/* parse SML file & stripping escape sequences */
-	file = sml_file_parse(buffer + 8, bytes - 16);
+bool MeterSML::_frame(unsigned char **payload, size_t *len) {
+	unsigned char *buf = &_buffer[0];
+
+	for (;;) {
+		if (_start == SML_NO_FRAME) { /* search start sequence */
+			while (_begin + 8 <= _end &&
+						 (memcmp(buf + _begin, sml_escape, 4) != 0 || memcmp(buf + _begin + 4, sml_start, 4) != 0)) {
+				_begin++;
+			}
+
+			if (_begin + 8 > _end) {
+				return false;
+			}
+
+			_start = _scan = _out = _begin + 8;
+		}
+
+		/* the payload is escaped in blocks of 4 bytes */
+		while (_scan + 4 <= _end) {
+			if (memcmp(buf + _scan, sml_escape, 4) != 0) {
+				if (_out != _scan) {
+					memmove(buf + _out, buf + _scan, 4);
+				}
+				_out += 4;
+				_scan += 4;
+				continue;
+			}
+
+			if (_scan + 8 > _end) {
+				return false; /* wait for the rest of the escape sequence */
+			}
+
+			const unsigned char *seq = buf + _scan + 4;
+			if (memcmp(seq, sml_escape, 4) == 0) { /* escaped escape sequence */
+				memcpy(buf + _out, sml_escape, 4);
+				_out += 4;
+				_scan += 8;
+			}
+			else if (seq[0] == 0x1a) { /* end sequence: 0x1a, padding bytes, CRC */
+				size_t padding = std::min((size_t) seq[1], _out - _start);
+
+				*payload = buf + _start;
+				*len = _out - _start - padding;
+
+				_begin = _scan + 8;
+				_start = SML_NO_FRAME;
+				return true;
+			}
+			else if (memcmp(seq, sml_start, 4) == 0) {
+				print(log_warning, "Incomplete datagram, resynchronizing", name().c_str());
+				_begin = _scan;
+				_start = SML_NO_FRAME;
+				break;
+			}
+			else {
+				print(log_warning, "Unknown escape sequence, dropping datagram", name().c_str());
+				_begin = _scan + 8;
+				_start = SML_NO_FRAME;
+				break;
+			}
+		}
+
+		if (_start != SML_NO_FRAME) {
+			return false; /* wait for more data */
+		}
+	}
+}
+
+size_t MeterSML::_compact() {
+	size_t base = (_start == SML_NO_FRAME) ? _begin : _start;
+
+	if (base > 0) {
+		memmove(&_buffer[0], &_buffer[base], _end - base);
+		_begin = (_begin > base) ? _begin - base : 0;
+		_end -= base;
+
+		if (_start != SML_NO_FRAME) {
+			_start -= base;
+			_scan -= base;
+			_out -= base;
+		}
+	}
+
+	if (_end == _buffer.size()) {
+		print(log_warning, "Datagram exceeds receive buffer, dropping it", name().c_str());
+		_begin = _end = 0;
+		_start = SML_NO_FRAME;
+	}
+
+	return _buffer.size() - _end;
+}
+
+size_t MeterSML::_parse_file(unsigned char *payload, size_t len, std::vector<Reading> &rds, size_t n) {
+	size_t m = 0;
+
+	/* fast path for the common GetListResponse */
+	if (_decode(payload, len, rds, n, &m)) {
+		return m;
+	}
+	m = 0;
+
+	/* parse SML file */
+	sml_file *file = sml_file_parse(payload, len);
+	if (file == NULL) {
+		print(log_warning, "Cannot parse datagram", name().c_str());
+		return 0;
+	}
 
 	/* obtain SML messagebody of type getResponseList */
 	for (short i = 0; i < file->messages_len; i++) {
 		sml_message *message = file->messages[i];
 
-		if (*message->message_body->tag == SML_MESSAGE_GET_LIST_RESPONSE) {
-			body = (sml_get_list_response *) message->message_body->data;
-			entry = body->val_list;
+		if (message->message_body && *message->message_body->tag == SML_MESSAGE_GET_LIST_RESPONSE) {
+			sml_get_list_response *body = (sml_get_list_response *) message->message_body->data;
 
 			/* iterating through linked list */
-			for (m = 0; m < n && entry != NULL; m++) {
-				_parse(entry, &rds[m]);
-				entry = entry->next;
+			for (sml_list *entry = body->val_list; m < n && entry != NULL; entry = entry->next) {
+				if (_parse(entry, &rds[m])) {
+					m++;
+				}
 			}
 		}
 	}
@@ -175,25 +557,141 @@ ssize_t MeterSML::read(std::vector<Reading> &rds, size_t n) {
 	/* free the malloc'd memory */
 	sml_file_free(file);
 
-	return m+1;
+	return m;
 }
 
-void MeterSML::_parse(sml_list *entry, Reading *rd) {
-	//int unit = (entry->unit) ? *entry->unit : 0;
-	int scaler = (entry->scaler) ? *entry->scaler : 1;
-	
-	rd->value(sml_value_to_double(entry->value) * pow(10, scaler));
-
-	Obis obis((unsigned char)entry->obj_name->str[0],
-						(unsigned char)entry->obj_name->str[1],
-						(unsigned char)entry->obj_name->str[2],
-						(unsigned char)entry->obj_name->str[3],
-						(unsigned char)entry->obj_name->str[4],
-						(unsigned char)entry->obj_name->str[5]);
-	ReadingIdentifier *rid(new ObisIdentifier(obis));
-	rd->identifier(rid);
+bool MeterSML::_decode(const unsigned char *payload, size_t len, std::vector<Reading> &rds, size_t n, size_t *m) {
+	tlv_cursor_t c = { payload, payload + len, false };
+	bool list_response = false;
+	size_t l;
+
+	while (c.p < c.end) {
+		if (*c.p == 0x00) { /* end of message or padding */
+			c.p++;
+			continue;
+		}
+
+		/* message: transaction id, group, abort on error, body, crc, end */
+		const unsigned char *message = c.p;
+		size_t first = *m;
+		double tag;
+
+		if (tlv_read(&c, &l) != TLV_LIST || l != 6) {
+			return false;
+		}
+		tlv_skip(&c);
+		tlv_skip(&c);
+		tlv_skip(&c);
+
+		if (tlv_read(&c, &l) != TLV_LIST || l != 2 || !tlv_number(&c, &tag)) {
+			return false;
+		}
+
+		if (tag != SML_MESSAGE_GET_LIST_RESPONSE) {
+			tlv_skip(&c);
+		}
+		else { /* client id, server id, list name, sensor time, list, signature, gateway time */
+			list_response = true;
+
+			if (tlv_read(&c, &l) != TLV_LIST || l != 7) {
+				return false;
+			}
+			tlv_skip(&c);
+			tlv_skip(&c);
+			tlv_skip(&c);
+			tlv_skip(&c);
+
+			size_t entries;
+			if (tlv_read(&c, &entries) != TLV_LIST) {
+				return false;
+			}
+
+			for (size_t i = 0; i < entries && !c.error; i++) {
+				/* name, status, time, unit, scaler, value, signature */
+				const unsigned char *name;
+				size_t name_len;
+				double value, scaler, unit;
+				int64_t mantissa;
+				time_t timestamp;
+				bool has_time, has_value;
+
+				if (tlv_read(&c, &l) != TLV_LIST || l != 7) {
+					return false;
+				}
+				bool has_name = tlv_octet(&c, &name, &name_len);
+				tlv_skip(&c);
+				has_time = tlv_time(&c, &timestamp);
+				if (!tlv_number(&c, &unit)) unit = 0;
+				if (!tlv_number(&c, &scaler)) scaler = 0;
+				has_value = tlv_number(&c, &value, &mantissa);
+				tlv_skip(&c);
+
+				if (c.error || !has_name || name_len != 6 || !has_value || *m >= n) {
+					continue; /* octet string values, e.g. the server id */
+				}
+
+				Reading &rd = rds[*m];
+				if ((double) mantissa == value) {
+					rd.value(mantissa, (int) scaler);
+				}
+				else { /* unsigned above INT64_MAX */
+					rd.value(value * Reading::pow10((int) scaler));
+				}
+				rd.unit((int) unit);
+				rd.identifier(ObisIdentifier(name));
+				if (has_time) {
+					struct timeval tv = { timestamp, 0 };
+					rd.time(tv);
+				}
+				else {
+					rd.time();
+				}
+				(*m)++;
+			}
+
+			tlv_skip(&c); /* signature */
+			tlv_skip(&c); /* gateway time */
+		}
+
+		/* check crc over the message up to the crc field */
+		const unsigned char *end = c.p;
+		double crc;
+		if (!tlv_number(&c, &crc) || c.error) {
+			return false;
+		}
+
+		uint16_t expected = crc16_x25(message, end - message);
+		if ((uint16_t) crc != expected && (uint16_t) crc != (uint16_t) ((expected >> 8) | (expected << 8))) {
+			print(log_warning, "CRC mismatch, dropping message", name().c_str());
+			*m = first;
+		}
+	}
+
+	return list_response && !c.error;
+}
+
+bool MeterSML::_parse(sml_list *entry, Reading *rd) {
+	if (entry->obj_name == NULL || entry->obj_name->len != 6 || entry->value == NULL) {
+		return false;
+	}
+
+	int unit = (entry->unit) ? *entry->unit : 0;
+	int scaler = (entry->scaler) ? *entry->scaler : 0;
+	int64_t mantissa;
+
+	if (sml_value_to_int64(entry->value, &mantissa)) {
+		rd->value(mantissa, scaler);
+	}
+	else {
+		rd->value(sml_value_to_double(entry->value) * Reading::pow10(scaler));
+	}
+
+	rd->unit(unit);
+
+	/* OBIS code is read directly from the list entry */
+	rd->identifier(ObisIdentifier((const unsigned char *) entry->obj_name->str));
 	
-	// TODO handle SML_TIME_SEC_INDEX or time by SML File/Message
+	// TODO handle TLV_TIME_SEC_INDEX or time by SML File/Message
 	struct timeval tv;
 	if (entry->val_time) { /* use time from meter */
 		tv.tv_sec = *entry->val_time->data.timestamp;
@@ -203,6 +701,8 @@ void MeterSML::_parse(sml_list *entry, Reading *rd) {
 		gettimeofday(&tv, NULL); /* use local time */
 	}
 	rd->time(tv);
+
+	return true;
 }
 
 int MeterSML::_openSocket(const char *node, const char *service) {
@@ -0,0 +1,231 @@
+/**
+ * Benchmark of the native SML decoder against libsml
+ *
+ * Decodes the telegrams of a recorded meter dump repeatedly, once with
+ * the native GetListResponse decoder of MeterSML and once with
+ * sml_file_parse(), and reports the time per telegram. Record a dump
+ * with e.g. "cat /dev/ttyUSB0 > ehz.bin".
+ *
+ * usage: sml_bench <dump> [iterations]
+ *
+ * @package vzlogger
+ * @copyright Copyright (c) 2011, The volkszaehler.org project
+ * @license http://www.gnu.org/licenses/gpl.txt GNU Public License
+ */
+/*
+ * This file is part of volkzaehler.org
+ *
+ * volkzaehler.org is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * volkzaehler.org is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <algorithm>
+#include <vector>
+#include <list>
+
+#include <common.h>
+#include "Options.hpp"
+#include "protocols/MeterSML.hpp"
+
+#define SML_BENCH_READINGS 64    /* reading slots per telegram */
+#define SML_BENCH_ITERATIONS 1000
+
+/**
+ * Only warnings and errors of the decoders are shown
+ */
+void print(log_level_t level, const char *format, const char *id, ... ) {
+	if (level > log_warning) {
+		return;
+	}
+
+	va_list args;
+	va_start(args, id);
+	fprintf(stderr, "[%s] ", id ? id : "");
+	vfprintf(stderr, format, args);
+	fprintf(stderr, "\n");
+	va_end(args);
+}
+
+/**
+ * Exposes both decoders of MeterSML on recorded telegrams
+ */
+class SMLBench : public MeterSML {
+
+public:
+	SMLBench(std::list<Option> options) : MeterSML(options) {}
+
+	/**
+	 * Split a recorded dump into the payloads of its transport frames
+	 */
+	void load(const std::vector<unsigned char> &dump, std::vector<std::vector<unsigned char> > &frames) {
+		unsigned char *payload;
+		size_t len, pos = 0;
+
+		while (pos < dump.size()) {
+			size_t chunk = std::min(_compact(), dump.size() - pos);
+			memcpy(&_buffer[_end], &dump[pos], chunk);
+			_end += chunk;
+			pos += chunk;
+
+			while (_frame(&payload, &len)) {
+				frames.push_back(std::vector<unsigned char>(payload, payload + len));
+			}
+		}
+	}
+
+	/**
+	 * @return number of readings, -1 if the native decoder cannot handle the telegram
+	 */
+	ssize_t native(std::vector<unsigned char> &frame, std::vector<Reading> &rds) {
+		size_t m = 0;
+		return _decode(&frame[0], frame.size(), rds, rds.size(), &m) ? (ssize_t) m : -1;
+	}
+
+	/**
+	 * @return number of readings, -1 if libsml cannot parse the telegram
+	 */
+	ssize_t libsml(std::vector<unsigned char> &frame, std::vector<Reading> &rds) {
+		size_t m = 0;
+
+		sml_file *file = sml_file_parse(&frame[0], frame.size());
+		if (file == NULL) {
+			return -1;
+		}
+
+		for (short i = 0; i < file->messages_len; i++) {
+			sml_message *message = file->messages[i];
+
+			if (message->message_body && *message->message_body->tag == SML_MESSAGE_GET_LIST_RESPONSE) {
+				sml_get_list_response *body = (sml_get_list_response *) message->message_body->data;
+
+				for (sml_list *entry = body->val_list; m < rds.size() && entry != NULL; entry = entry->next) {
+					if (_parse(entry, &rds[m])) {
+						m++;
+					}
+				}
+			}
+		}
+
+		sml_file_free(file);
+		return m;
+	}
+};
+
+static double elapsed(const struct timespec &start) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <dump> [iterations]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	int iterations = (argc > 2) ? atoi(argv[2]) : SML_BENCH_ITERATIONS;
+
+	FILE *fp = fopen(argv[1], "rb");
+	if (fp == NULL) {
+		fprintf(stderr, "Cannot open %s: %s\n", argv[1], strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	std::vector<unsigned char> dump;
+	unsigned char buf[4096];
+	size_t bytes;
+	while ((bytes = fread(buf, 1, sizeof(buf), fp)) > 0) {
+		dump.insert(dump.end(), buf, buf + bytes);
+	}
+	fclose(fp);
+
+	std::list<Option> options;
+	options.push_back(Option("device", (char *) argv[1]));
+	SMLBench sml(options);
+
+	std::vector<std::vector<unsigned char> > frames;
+	sml.load(dump, frames);
+	if (frames.empty()) {
+		fprintf(stderr, "No SML telegrams found in %s\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	/* both decoders have to agree before their speed is compared */
+	std::vector<Reading> native(SML_BENCH_READINGS), libsml(SML_BENCH_READINGS);
+	size_t decoded = 0, readings = 0;
+
+	for (size_t f = 0; f < frames.size(); f++) {
+		ssize_t n = sml.native(frames[f], native);
+		ssize_t l = sml.libsml(frames[f], libsml);
+
+		if (n < 0) {
+			continue; /* falls back to libsml */
+		}
+		if (n != l) {
+			fprintf(stderr, "Telegram %lu: native decoder found %li readings, libsml %li\n", f, (long) n, (long) l);
+			return EXIT_FAILURE;
+		}
+		for (ssize_t i = 0; i < n; i++) {
+			if (native[i].value() != libsml[i].value() || native[i].unit() != libsml[i].unit()) {
+				fprintf(stderr, "Telegram %lu: reading %li differs (%f %i != %f %i)\n", f, (long) i,
+								native[i].value(), native[i].unit(), libsml[i].value(), libsml[i].unit());
+				return EXIT_FAILURE;
+			}
+		}
+		decoded++;
+		readings += n;
+	}
+
+	printf("%lu telegrams, %lu decoded natively with %lu readings\n", frames.size(), decoded, readings);
+
+	struct timespec start;
+	double t_native, t_libsml;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int k = 0; k < iterations; k++) {
+		for (size_t f = 0; f < frames.size(); f++) {
+			sml.native(frames[f], native);
+		}
+	}
+	t_native = elapsed(start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int k = 0; k < iterations; k++) {
+		for (size_t f = 0; f < frames.size(); f++) {
+			sml.libsml(frames[f], libsml);
+		}
+	}
+	t_libsml = elapsed(start);
+
+	double telegrams = (double) iterations * frames.size();
+	printf("native:         %10.0f ns/telegram\n", t_native / telegrams * 1e9);
+	printf("sml_file_parse: %10.0f ns/telegram\n", t_libsml / telegrams * 1e9);
+	printf("speedup:        %10.1f\n", t_libsml / t_native);
+
+	return EXIT_SUCCESS;
+}
+
+/*
+ * Local variables:
+ *  tab-width: 2
+ *  c-indent-level: 2
+ *  c-basic-offset: 2
+ *  project-name: vzlogger
+ * End:
+ */
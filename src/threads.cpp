@@ -32,6 +32,7 @@
 #include <ApiIF.hpp>
 #include <api/Volkszaehler.hpp>
 #include <api/MySmartGrid.hpp>
+#include <api/Uploader.hpp>
 
 extern Config_Options options;
 
@@ -69,86 +70,14 @@ void * reading_thread(void *arg) {
 			n = mtr->read(rds, details->max_readings);
 			delta = time(NULL) - last;
 
-			/* dumping meter output */
-			if (options.verbosity() > log_debug) {
-				print(log_debug, "Got %i new readings from meter:", mtr->name(), n);
-
-				char identifier[MAX_IDENTIFIER_LEN];
-				for (size_t i = 0; i < n; i++) {
-                    rds[i].unparse(/*mtr->protocolId(),*/ identifier, MAX_IDENTIFIER_LEN);
-					print(log_debug, "Reading: id=%s/%s value=%.2f ts=%.3f", mtr->name(),
-								identifier, rds[i].identifier()->toString().c_str(),
-								rds[i].value(), rds[i].tvtod());
-				}
-			}
-
 			/* update buffer length with current interval */
 			if (details->periodic == FALSE && delta > 0 && delta != mtr->interval()) {
 				print(log_debug, "Updating interval to %i", mtr->name(), delta);
 				mtr->interval(delta);
 			}
 
-			/* insert readings into channel queues */
-			for(MeterMap::iterator ch = mapping->begin(); ch!=mapping->end(); ch++) {
-				Reading *add = NULL;
-
-				//print(log_debug, "Check channel %s, n=%d", mtr->name(), ch->name(), n);
-
-				for (size_t i = 0; i < n; i++) {
-					if ( *rds[i].identifier().get() == *(*ch)->identifier().get()) {
-						//print(log_debug, "found channel", mtr->name());
-						if ((*ch)->tvtod() < rds[i].tvtod()) {
-							(*ch)->last(&rds[i]);
-						}
-
-						print(log_info, "Adding reading to queue (value=%.2f ts=%.3f)", (*ch)->name(),
-									rds[i].value(), rds[i].tvtod());
-						(*ch)->push(rds[i]);
-
-						if (add == NULL) {
-							add = &rds[i]; /* remember first reading which has been added to the buffer */
-						}
-					}
-				}
-
-				/* update buffer length */
-				if (options.local()) {
-					(*ch)->buffer()->keep((mtr->interval() > 0) ? ceil(options.buffer_length() / mtr->interval()) : 0);
-				}
-
-				/* queue reading into sending buffer logging thread if
-					 logging is enabled & sent queue is empty */
-				//if (options.logging()) {
-				//ch->push(buf->sent = add);
-				//}
-
-				/* shrink buffer */
-				(*ch)->buffer()->clean();
-
-				/* notify webserver and logging thread */
-				(*ch)->notify();
-
-				/* debugging */
-				if (options.verbosity() >= log_debug) {
-					size_t dump_len = 24;
-					char *dump = (char*)malloc(dump_len);
-
-					if (dump == NULL) {
-						print(log_error, "cannot allocate buffer", (*ch)->name());
-					}
-
-					while (dump == NULL || (*ch)->dump(dump, dump_len) == NULL) {
-						dump_len *= 1.5;
-						free(dump);
-						dump = (char*)malloc(dump_len);
-					}
-
-					print(log_debug, "Buffer dump (size=%i keep=%i): %s", (*ch)->name(),
-								(*ch)->size(), (*ch)->keep(), dump);
-
-					free(dump);
-				}
-			}
+			/* hand readings over to the channels */
+			mapping->dispatch(rds, n);
 
 			if ((options.daemon() || options.local()) && details->periodic) {
 				print(log_info, "Next reading in %i seconds", mtr->name(), mtr->interval());
@@ -36,6 +36,7 @@
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <fcntl.h>
+#include <poll.h>
 
 #include <list>
 
@@ -45,6 +46,9 @@
 #include "vzlogger.h"
 #include "Channel.hpp"
 #include "threads.h"
+#include <api/Uploader.hpp>
+#include <MeterReactor.hpp>
+#include <MeterScheduler.hpp>
 
 #ifdef LOCAL_SUPPORT
 #include "local.h"
@@ -53,7 +57,8 @@
 
 MapContainer mappings;	/* mapping between meters and channels */
 Config_Options options;	/* global application options */
-bool gStop = false;
+volatile sig_atomic_t gStop = 0;	/* signal to terminate on, set by quit() */
+static int gWakeup[2] = { -1, -1 };	/* self-pipe to wake up main() from quit() */
 
 /**
  * Command line options
@@ -183,6 +188,19 @@ void show_usage(char *argv[]) {
 	printf("send bugreports to %s\n", PACKAGE_BUGREPORT);
 }
 
+/**
+ * @return true if an enabled meter runs commands, they are reaped with waitpid()
+ */
+static bool exec_meters() {
+	for (MapContainer::iterator it = mappings.begin(); it != mappings.end(); it++) {
+		if (it->meter()->isEnabled() && it->meter()->protocolId() == meter_protocol_exec) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
 /**
  * Fork process to background
  *
@@ -222,20 +240,27 @@ void daemonize() {
 	action.sa_flags = 0;
 	action.sa_handler = SIG_IGN;
 
-	sigaction(SIGCHLD, &action, NULL); /* ignore child */
 	sigaction(SIGTSTP, &action, NULL); /* ignore tty signals */
 	sigaction(SIGTTOU, &action, NULL);
 	sigaction(SIGTTIN, &action, NULL);
+
+	/* ignore child, unless the exit status of commands is needed */
+	action.sa_handler = (exec_meters()) ? SIG_DFL : SIG_IGN;
+	sigaction(SIGCHLD, &action, NULL);
 }
 
 /**
- * Cancel threads
+ * Request termination
  *
- * Threads gets joined in main()
+ * Only sets a flag and wakes up main(), which cancels and joins the threads.
  */
 void quit(int sig) {
-	//gStop = true;
-	mappings.quit(sig);
+	int saved = errno;
+
+	gStop = sig;
+	if (write(gWakeup[1], "", 1) < 0) {}
+
+	errno = saved;
 }
 
 /**
@@ -330,22 +355,13 @@ void register_device() {
  * The application entrypoint
  */
 int main(int argc, char *argv[]) {
-
-	/* bind signal handler */
-	struct sigaction action;
-	sigemptyset(&action.sa_mask);
-	action.sa_flags = 0;
-	action.sa_handler = quit;
+	bool stopped = false;
 
 #ifdef LOCAL_SUPPORT
 	/* webserver for local interface */
 	struct MHD_Daemon *httpd_handle = NULL;
 #endif /* LOCAL_SUPPORT */
 
-	sigaction(SIGINT, &action, NULL);	/* catch ctrl-c from terminal */
-	sigaction(SIGHUP, &action, NULL);	/* catch hangup signal */
-	sigaction(SIGTERM, &action, NULL);	/* catch kill signal */
-
 	/* initialize ADTs and APIs */
 	curl_global_init(CURL_GLOBAL_ALL);
 
@@ -403,6 +419,21 @@ int main(int argc, char *argv[]) {
 		return EXIT_FAILURE;
 	}
 
+	/* bind signal handler, after daemonize() closed all descriptors */
+	if (pipe2(gWakeup, O_CLOEXEC | O_NONBLOCK) < 0) {
+		print(log_error, "Cannot create wakeup pipe: %s", (char*)0, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	struct sigaction action;
+	sigemptyset(&action.sa_mask);
+	action.sa_flags = 0;
+	action.sa_handler = quit;
+
+	sigaction(SIGINT, &action, NULL);	/* catch ctrl-c from terminal */
+	sigaction(SIGHUP, &action, NULL);	/* catch hangup signal */
+	sigaction(SIGTERM, &action, NULL);	/* catch kill signal */
+
 	print(log_debug, "===> Start meters.", "");
 	try {
 		/* open connection meters & start threads */
@@ -410,6 +441,17 @@ int main(int argc, char *argv[]) {
 			it->start();
 		}
 
+		/* start reactor for event driven meters */
+		MeterReactor::instance().start();
+
+		/* start scheduler for periodic meters */
+		MeterScheduler::instance().start();
+
+		/* start shared uploader for all volkszaehler channels */
+		if (options.logging()) {
+			vz::api::Uploader::instance().start();
+		}
+
 #ifdef LOCAL_SUPPORT
 		/* start webserver for local interface */
 		if (options.local()) {
@@ -429,16 +471,34 @@ int main(int argc, char *argv[]) {
 	print(log_debug, "Startup done.", "");
 
 	try {
-		do {
-			/* wait for all threads to terminate */
+		/* wait for a signal, meanwhile check for meters which terminated by themselves */
+		while (!gStop && !stopped) {
+			struct pollfd pfd;
+			pfd.fd = gWakeup[0];
+			pfd.events = POLLIN;
+
+			if (poll(&pfd, 1, STOP_CHECK_INTERVAL * 1000) > 0) {
+				break; /* woken up by quit() */
+			}
+
 			for(MapContainer::iterator it = mappings.begin(); it!=mappings.end(); it++) {
-				bool ret = it->stopped();
-				if(ret) gStop = true;
+				if (it->stopped()) stopped = true;
 			}
-		} while (!gStop);
+		}
 	} catch ( std::exception &e) {
 		print(log_error, "MainLOOP failed for %s", "", e.what());
 	}
+
+	/* cancel and join the remaining threads */
+	mappings.quit(gStop);
+	MeterReactor::instance().cancel();
+	MeterScheduler::instance().cancel();
+
+	/* complete aggregation windows, they are sent with the final upload */
+	for(MapContainer::iterator it = mappings.begin(); it!=mappings.end(); it++) {
+		it->flush();
+	}
+	vz::api::Uploader::instance().cancel();
 	print(log_debug, "Server stopped.", "");
 
 #ifdef LOCAL_SUPPORT
@@ -456,5 +516,8 @@ int main(int argc, char *argv[]) {
 		fclose(options.logfd());
 	}
 
+	close(gWakeup[0]);
+	close(gWakeup[1]);
+
 	return EXIT_SUCCESS;
 }